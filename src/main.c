@@ -1,360 +1,3889 @@
-
+#ifndef ESP_PLATFORM
+#define _GNU_SOURCE // ppoll, gettid and per-thread timer signals on the host port
+#endif
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#ifdef ESP_PLATFORM
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include "sdkconfig.h"
 #include "esp_timer.h"
-#include <stdbool.h>
 #include "esp_rom_sys.h" // For esp_rom_delay_us
 #include "driver/timer.h" // For hardware timer interrupts
+#include "esp_intr_alloc.h"
+#include "esp_task_wdt.h"
+#include "soc/periph_defs.h"
+#include "freertos/FreeRTOS.h" // For the TCB whose saved stack pointer the interrupt exit restores, and to start core 1
+#include "freertos/task.h"
+#include "xtensa/corebits.h"
+#include "xtensa/hal.h"
+#include "xtensa/xtruntime.h"
+#include "xtensa/xtensa_api.h"
+#include "xtensa_context.h"
+
+#define NUM_CORES portNUM_PROCESSORS
+#define TASK_STACK_SIZE 4096 // Enough for ESP_LOGx inside a task
+
+// Saved task context: pointer to the interrupt frame (XtExcFrame) on the task's own stack
+typedef struct {
+    uint32_t *frame;
+} port_context_t;
+
+typedef uint32_t port_irq_state_t;
+#define PORT_CYCLES_PER_US CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#define PORT_CACHE_LINE_SIZE 32
+
+static inline port_irq_state_t IRAM_ATTR port_irq_disable(void) {
+    return XTOS_SET_INTLEVEL(XCHAL_EXCM_LEVEL);
+}
+
+static inline void IRAM_ATTR port_irq_restore(port_irq_state_t state) {
+    XTOS_RESTORE_INTLEVEL(state);
+}
+
+static inline uint32_t IRAM_ATTR port_cycle_count(void) {
+    return xthal_get_ccount();
+}
+
+static inline int IRAM_ATTR port_core_id(void) {
+    return xPortGetCoreID();
+}
+#else
+// Linux host port: build with `cc -O2 -pthread src/main.c -o rtos`
+// Add -DRTOS_VIRTUAL_CLOCK to simulate time instead of sleeping
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#define IRAM_ATTR
+#define TASK_STACK_SIZE (64 * 1024) // libc calls and signal frames need more than the target
+
+// Cores are threads; SIGALRM is each core's tick and SIGUSR1 the inter-processor interrupt
+#ifndef NUM_CORES
+#ifdef RTOS_VIRTUAL_CLOCK
+#define NUM_CORES 1
+#else
+#define NUM_CORES 2
+#endif
+#endif
+#if defined(RTOS_VIRTUAL_CLOCK) && NUM_CORES > 1
+#error "The virtual clock simulates a single core"
+#endif
+
+// Saved task context; the tick and IPI signals are masked as part of it
+typedef ucontext_t port_context_t;
+
+typedef sigset_t port_irq_state_t;
+#define PORT_CYCLES_PER_US 1000 // Host "cycles" are nanoseconds
+#define PORT_CACHE_LINE_SIZE 64
+
+static __thread int host_core_id; // The main thread is core 0
+static __thread port_context_t *host_pending_from; // Switch requested with interrupts disabled
+static __thread port_context_t *host_pending_to;
+
+static inline port_irq_state_t port_irq_disable(void) {
+    sigset_t block, state;
+    sigemptyset(&block);
+    sigaddset(&block, SIGALRM);
+    sigaddset(&block, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &block, &state);
+    return state;
+}
+
+// Like the target's yield interrupt, a switch requested while disabled happens as interrupts come back on
+static inline void port_irq_restore(port_irq_state_t state) {
+    if (host_pending_to != NULL && !sigismember(&state, SIGALRM)) {
+        port_context_t *from = host_pending_from;
+        port_context_t *to = host_pending_to;
+        host_pending_to = NULL;
+        swapcontext(from, to);
+    }
+    pthread_sigmask(SIG_SETMASK, &state, NULL);
+}
+
+static inline uint32_t port_cycle_count(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static inline int port_core_id(void) {
+    return host_core_id;
+}
+
+#ifdef RTOS_VIRTUAL_CLOCK
+#ifndef RTOS_SIM_DURATION_US
+#define RTOS_SIM_DURATION_US (3600ULL * 1000000) // One hour of simulated time
+#endif
+
+// Simulated time: busy delays and idle waits advance the clock instantly
+static int64_t virtual_time_us = 0;
+static void (*virtual_timer_isr)(void *); // Set by port_timer_start()
+static int64_t virtual_timer_period_us;
+static int64_t virtual_next_tick_us;
+
+static inline int64_t esp_timer_get_time(void) {
+    return virtual_time_us;
+}
+
+// Busy work is CPU time: it advances the clock and takes the simulated timer interrupt on the way
+static inline void esp_rom_delay_us(uint32_t us) {
+    while (us > 0) {
+        if (virtual_timer_isr == NULL) {
+            virtual_time_us += us;
+            return;
+        }
+        if (virtual_next_tick_us <= virtual_time_us) { // Ticks during idle waits are not simulated
+            virtual_next_tick_us = virtual_time_us - virtual_time_us % virtual_timer_period_us + virtual_timer_period_us;
+        }
+        uint32_t step = virtual_next_tick_us - virtual_time_us < us ? virtual_next_tick_us - virtual_time_us : us;
+        virtual_time_us += step;
+        us -= step;
+        if (virtual_time_us == virtual_next_tick_us) {
+            sigset_t mask;
+            virtual_next_tick_us += virtual_timer_period_us;
+            pthread_sigmask(SIG_BLOCK, NULL, &mask);
+            if (!sigismember(&mask, SIGALRM)) {
+                virtual_timer_isr(NULL); // May switch away; the rest of the work continues when resumed
+            }
+        }
+    }
+}
+#else
+static inline int64_t esp_timer_get_time(void) {
+    static int64_t boot_us = -1; // Report time since start, like the on-chip timer
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    if (boot_us < 0) boot_us = us;
+    return us - boot_us;
+}
+
+static inline void esp_rom_delay_us(uint32_t us) {
+    int64_t end = esp_timer_get_time() + us; // Spin like the ROM routine, so SIGALRM can preempt it
+    while (esp_timer_get_time() < end);
+}
+#endif
+
+#define ESP_LOG_HOST(level, tag, format, ...) \
+    printf(level " (%u) %s: " format "\n", (unsigned)(esp_timer_get_time() / 1000), tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_HOST("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_HOST("W", tag, format, ##__VA_ARGS__)
+#endif
 
-#define TASK_STACK_SIZE 1024
+#include "queue.h"
+
+#ifndef MAX_TASKS
 #define MAX_TASKS 5
-#define MAX_QUEUE_SIZE 10
-#define INT_MAX 999
+#endif
+#define MAX_PRIORITIES 32 // One ready-bitmap bit per priority level
+#ifndef MAX_STACKS
+#define MAX_STACKS MAX_TASKS // Stackful tasks; coroutine tasks need none
+#endif
+#define CORE_ANY -1 // Task affinity: let the scheduler place the task
+#ifndef STEAL_DEQUE_SIZE
+#define STEAL_DEQUE_SIZE 64 // Power of two; ready tasks beyond it are just not offered for stealing
+#endif
+#ifndef MUTEX_SPIN_LIMIT
+#define MUTEX_SPIN_LIMIT 100 // Default checks of a mutex held on another core before blocking
+#endif
+#ifndef MAX_CRITICAL_SECTIONS
+#define MAX_CRITICAL_SECTIONS 8 // Declared for the blocking term of admission control
+#endif
+#ifndef QUEUE_SET_MAX_MEMBERS
+#define QUEUE_SET_MAX_MEMBERS 8 // Queues and semaphores per queue set
+#endif
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6 // 64 slots per level: one bit each of a uint64_t
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#ifndef WHEEL_TICK_SHIFT
+#define WHEEL_TICK_SHIFT 2 // Level-0 slots span 2^2 us, so the four levels span 2^26 us (67 s); later wakes re-cascade
+#endif
+#ifndef RELEASE_WHEEL
+#define RELEASE_WHEEL (MAX_TASKS > 256) // Per-core release queue: the timing wheel, or a binary heap for fewer tasks
+#endif
 
 // Task states
 typedef enum {
     TASK_READY,
     TASK_RUNNING,
     TASK_WAITING,
+    TASK_BLOCKED, // On a synchronization object's wait list
     TASK_TERMINATED
 } task_state_t;
 
+// What to do when a job finishes after its next release time has already passed
+typedef enum {
+    OVERRUN_SKIP,     // Drop the missed releases and stay on the original phase
+    OVERRUN_CATCH_UP, // Release every missed period back-to-back
+    OVERRUN_REPHASE   // Restart the period from the moment the job finished
+} overrun_policy_t;
+
+// Whether an idle core may steal the task's ready job
+typedef enum {
+    MIGRATE_NEVER,    // Only ever runs on its own core
+    MIGRATE_UNPINNED, // Stealable while its affinity is CORE_ANY; the thief becomes its core (default)
+    MIGRATE_JOBS      // Stealable even when pinned: a pinned task returns to its core after the stolen job
+} migration_t;
+
+// Result of adding or changing a task
+typedef enum {
+    ADMIT_OK,
+    ADMIT_ERR_MAX_TASKS,     // task_list (or, for stackful tasks, task_stacks) is full
+    ADMIT_ERR_PRIORITY,      // Priority outside 0..MAX_PRIORITIES-1
+    ADMIT_ERR_UNSCHEDULABLE, // Admission control: the task set could miss deadlines
+    ADMIT_ERR_CORE,          // Affinity outside CORE_ANY, 0..NUM_CORES-1
+    ADMIT_ERR_CEILING,       // Critical section on a mutex without a ceiling, by a task above the ceiling, or under EDF
+    ADMIT_ERR_MAX_SECTIONS   // critical_sections is full
+} admit_result_t;
+
 // Task function pointer
 typedef void (*task_func_t)(void *);
 
+// Stackless coroutine tasks (protothreads). The body runs on the core's main loop stack and
+// returns at every CO_AWAIT_*; the next call jumps back to that point through the switch in
+// CO_BEGIN. Local variables do not survive an await: keep state in `param` or in statics.
+typedef enum {
+    CO_DONE,    // Job finished (reached CO_END)
+    CO_YIELDED, // Back of the ready list at its priority
+    CO_WAITING  // Not ready again until wait_us have passed
+} co_status_t;
+
+typedef struct {
+    uint32_t resume; // Line of the await to continue from (0 = start of a new job)
+    uint32_t wait_us;
+} coroutine_t;
+
+typedef co_status_t (*coroutine_func_t)(coroutine_t *co, void *param);
+
+#define CO_BEGIN(co) switch ((co)->resume) { case 0:
+#define CO_END(co) } (co)->resume = 0; return CO_DONE
+
+// Give the CPU to other ready tasks at the same or higher priority
+#define CO_YIELD(co) \
+    do { (co)->resume = __LINE__; return CO_YIELDED; case __LINE__:; } while (0)
+
+#define CO_AWAIT_DELAY_US(co, us) \
+    do { (co)->wait_us = (us); (co)->resume = __LINE__; return CO_WAITING; case __LINE__:; } while (0)
+#define CO_AWAIT_DELAY_MS(co, ms) CO_AWAIT_DELAY_US(co, (uint32_t)(ms) * 1000)
+
+// Re-check `cond` once per tick, sleeping in between. The first check falls through into the resume point.
+#define CO_AWAIT_UNTIL(co, cond) \
+    do { \
+        (co)->resume = __LINE__; __attribute__((fallthrough)); case __LINE__:; \
+        if (!(cond)) { (co)->wait_us = TICK_PERIOD_US; return CO_WAITING; } \
+    } while (0)
+
+#define CO_AWAIT_SEMAPHORE(co, sem) CO_AWAIT_UNTIL(co, semaphore_try_wait(sem))
+#define CO_AWAIT_QUEUE(co, queue, item) CO_AWAIT_UNTIL(co, queue_pop(queue, &(item)))
+#define CO_AWAIT_MPMC(co, queue, item) CO_AWAIT_UNTIL(co, mpmc_queue_try_pop(queue, &(item)))
+
+// Link in a release wheel's slot lists, or a slot of a release heap, embedded in each task and software timer
+typedef struct wheel_entry {
+    uint64_t time; // When it is due (us)
+    struct wheel_entry *prev; // Neighbours in its slot's list (NULL = none)
+    struct wheel_entry *next;
+    int slot; // level * WHEEL_SLOTS + slot while on a wheel, position on a release heap (-1 = none)
+} wheel_entry_t;
+
 // Task control block
 typedef struct {
     task_func_t func;
+    coroutine_func_t co_func; // Set instead of func for a coroutine task
+    coroutine_t co;
     void *param;
     uint32_t interval_ms;
+    uint32_t deadline_ms; // Relative deadline, defaults to interval_ms
+    uint32_t wcet_us; // Declared worst-case execution time per job (0 = not declared)
     uint64_t last_run;
+    uint64_t next_release; // Absolute time (us) the task becomes ready again
+    wheel_entry_t wheel; // On its core's release queue while waiting or timing a block, due at next_release or the end of a wait in the middle of a job
+    uint64_t deadline; // Absolute deadline (us) of the current job
+    uint64_t max_jitter_us; // Worst delay between release and dispatch
+    uint32_t jobs; // Completed jobs
+    uint32_t deadline_misses; // Jobs that finished after their deadline
+    uint32_t overruns; // Jobs that finished after their next release
+    overrun_policy_t overrun_policy;
     task_state_t state;
-    int priority; // Priority for scheduling
+    int priority; // Priority for scheduling: base_priority, or higher while inherited through a mutex
+    int base_priority; // Priority given to scheduler_add_task()
+    struct mutex *blocked_on; // Mutex the task is blocked on (NULL = none)
+    struct mutex *held; // Mutexes the task owns, linked through next_held
+    bool suspended; // Waiting in the middle of a job (delayed, or blocked with a timeout) rather than for its next release
+    int affinity; // Core the task is pinned to, or CORE_ANY
+    int core; // Core whose queues hold the task (changed only with that core and the new one locked)
+    migration_t migration;
+    volatile bool on_cpu; // Context still live on some core: set at dispatch, cleared once switched out
+    int heap_index; // Position in its core's deadline_heap while ready under EDF (-1 = none)
+    uint8_t *stack; // TASK_STACK_SIZE bytes from task_stacks (NULL for coroutines)
+    port_context_t context; // Registers saved while the task is switched out
+    int prev_ready; // Neighbours in the per-priority ready list (-1 = none)
+    int next_ready;
+    int next_waiter; // Next task in the wait list it is blocked on, as index + 1 (0 = none)
+    uint32_t event_mask; // Bits awaited in event_group_wait() (0 once the wait is satisfied)
+    uint32_t event_bits; // Group bits that satisfied the wait
+    bool event_all; // Wait for all of event_mask rather than any
+    bool event_clear; // Clear event_mask from the group once satisfied
+    bool triggered; // Released by scheduler_activate() or a bound source rather than by the clock
+    bool activation_pending; // Activated again before its current job finished
+    uint32_t activation_mask; // Event bits that activate it
+    int next_activated; // Next task activated by the same event group, as index + 1 (0 = none)
 } task_t;
 
-// Queue for inter-task communication
+// Ready list for one priority level (task indices, FIFO)
+typedef struct {
+    int head;
+    int tail;
+} ready_list_t;
+
+// Binary min-heap of task indices, ordered by the uint64_t task_t field at key_offset
 typedef struct {
-    void *items[MAX_QUEUE_SIZE];
-    int front;
-    int rear;
+    int items[MAX_TASKS];
     int size;
-} queue_t;
+    size_t key_offset;
+} task_heap_t;
 
-// Event flag
+// Chase-Lev work-stealing deque of task indices. The owning core pushes and pops at the bottom
+// (always with its lock held); other cores steal from the top without locking.
 typedef struct {
-    volatile bool flag;
-} event_flag_t;
+    volatile int32_t top;
+    volatile int32_t bottom;
+    volatile int items[STEAL_DEQUE_SIZE];
+} steal_deque_t;
 
-// Semaphore
+// Hierarchical timing wheel of entries keyed on their due time. A level-0 slot spans one tick of
+// 2^WHEEL_TICK_SHIFT us, and a slot of level L one whole turn of level L-1; its tasks are cascaded
+// into the lower levels as that turn begins. Entries keep their exact time, and level 0 releases
+// them at that time, not at the start of their slot.
 typedef struct {
-    volatile int count;
+    wheel_entry_t *slots[WHEEL_LEVELS][WHEEL_SLOTS]; // List heads (NULL = empty)
+    uint64_t occupied[WHEEL_LEVELS]; // Bit per non-empty slot
+    uint64_t tick; // Current tick: all earlier level-0 slots have been released
+    int size;
+} release_wheel_t;
+
+// Binary min-heap of entries keyed on their due time. O(log n), but for a few dozen tasks cheaper than
+// the wheel's bit scans and cascades.
+typedef struct {
+    wheel_entry_t *items[MAX_TASKS];
+    int size;
+} release_heap_t;
+
+// Each core keeps its waiting tasks on a wheel or a heap, chosen at build time by RELEASE_WHEEL. The
+// timer service always uses a wheel, since the number of timers has no bound.
+#if RELEASE_WHEEL
+typedef release_wheel_t release_queue_t;
+#define release_queue_init release_wheel_init
+#define release_queue_push release_wheel_push
+#define release_queue_remove release_wheel_remove
+#define release_queue_expire release_wheel_expire
+#define release_queue_next_time release_wheel_next_time
+#else
+typedef release_heap_t release_queue_t;
+#define release_queue_init release_heap_init
+#define release_queue_push release_heap_push
+#define release_queue_remove release_heap_remove
+#define release_queue_expire release_heap_expire
+#define release_queue_next_time release_heap_next_time
+#endif
+
+// Context switch latency: from the switch request to the first instruction of the incoming context
+typedef struct {
+    uint32_t count;
+    uint64_t total_cycles;
+    uint32_t max_cycles;
+} context_switch_stats_t;
+
+// Per-core scheduler state. The queues are only changed with interrupts disabled and `lock` held;
+// another core that changes them sends this core an IPI.
+typedef struct {
+    volatile bool lock;
+
+    // Ready tasks: bit (31 - priority) is set while ready_lists[priority] is non-empty,
+    // so the highest ready priority is a single count-leading-zeros away
+    uint32_t ready_bitmap;
+    ready_list_t ready_lists[MAX_PRIORITIES];
+
+    // Waiting tasks keyed on their wake time. On the wheel, adding, removing and releasing are O(1) and
+    // the next wakeup is a few bit scans away; on the heap, the next wakeup is its top.
+    release_queue_t release_queue;
+
+    // Ready tasks under EDF, keyed on their absolute deadline
+    task_heap_t deadline_heap;
+
+    // Stealable ready tasks, offered to idle cores. Entries are hints: a thief re-checks the task
+    // under both locks, so tasks dispatched meanwhile are simply skipped.
+    steal_deque_t steal_deque;
+
+    port_context_t scheduler_context; // The core's main loop, which dispatches into the tasks
+    volatile int current_task; // Running task (-1 while the main loop runs)
+    int switched_out; // Task whose context the pending switch saves (-1 = the main loop)
+    int rr_next; // Round-robin cursor
+    volatile bool wake; // Set by the IPI: the main loop re-checks the queues instead of sleeping
+    volatile bool idle; // Main loop waiting for work
+    uint64_t idle_since; // Start of the current idle wait (0 = not idle)
+    uint64_t idle_us; // Time spent waiting for work, i.e. CPU time left to other work
+    uint32_t jobs; // Jobs completed on this core
+    uint32_t steals; // Jobs this core took from other cores
+
+    context_switch_stats_t context_switch_stats;
+    volatile uint32_t context_switch_start; // Cycle count of the pending switch (0 = none)
+} core_t;
+
+// Event group: 32 independent event bits. Tasks block in event_group_wait() until any or all of a
+// mask of bits are set; one event_group_set() wakes every waiter it satisfies.
+typedef struct {
+    volatile uint32_t bits;
+    volatile bool lock; // Guards waiters
+    volatile bool waiting; // Set while tasks block (or are about to) on the group
+    wait_list_t waiters;
+    int activates; // Tasks activated when their activation_mask bits are set, as index + 1, linked through next_activated
+} event_group_t;
+
+// Semaphore. Uncontended takes and gives are a single compare-and-swap or atomic add on `count`
+// (S32C1I on the ESP32), without masking interrupts. A task that finds it taken blocks on `waiters`,
+// and a give hands the count straight to the highest-priority waiter.
+typedef struct {
+    volatile int count; // Available count, or minus the number of tasks blocking on it
+    volatile bool lock; // Guards waiters and handoffs
+    int handoffs; // Counts given to a blocking task that has not reached the wait list yet
+    wait_list_t waiters;
+    struct queue_set *set; // Queue set it belongs to (NULL = none)
+    int activates; // Task activated by each give that finds no waiter, as index + 1 (0 = none)
 } semaphore_t;
 
-// Mutex
+// Queue set: a task blocks in queue_set_select() until any member queue has an item or any member
+// semaphore a count. queue_send() and semaphore_signal() wake it. A zeroed queue set is empty.
+typedef struct queue_set {
+    volatile bool lock; // Guards waiters
+    volatile bool waiting; // Set while a task blocks (or is about to) in queue_set_select()
+    wait_list_t waiters;
+    struct {
+        void *object; // queue_t or semaphore_t
+        bool semaphore;
+    } members[QUEUE_SET_MAX_MEMBERS];
+    int count;
+    int next; // Member to check first, so a busy one cannot starve the rest
+} queue_set_t;
+
+// Mutex with priority inheritance: while tasks are blocked on it, its owner runs at the priority of
+// the highest of them, passed along chains of nested mutexes. A mutex given a ceiling with
+// mutex_init_ceiling() instead raises its owner to the ceiling as soon as it is locked (immediate
+// priority ceiling), so no task that uses it can preempt the owner on its core. Both act on priority
+// only: under SCHEDULER_EDF a task with an earlier deadline still preempts the owner.
+#define MUTEX_CONTENDED 0x40000000 // Owner bit: tasks are blocked on the mutex
+#define MUTEX_OWNER_NONTASK 0x3fffffff // Owner value for the main loop, coroutines and code outside tasks
+
+// Contention statistics, updated by the owner (spins by the waiters, atomically)
 typedef struct {
-    volatile bool locked;
+    uint32_t acquisitions;
+    uint32_t contended; // Acquisitions that had to spin or block first
+    uint32_t spins; // Checks made while spinning on the owner
+    uint32_t max_hold_us;
+} mutex_stats_t;
+
+typedef struct mutex {
+    volatile int owner; // Owning task index + 1 (0 = unlocked), plus MUTEX_CONTENDED
+    wait_list_t waiters;
+    struct mutex *next_held; // Next mutex held by the same owner
+    int ceiling; // Ceiling priority + 1 (0 = priority inheritance)
+    uint64_t locked_at;
+    mutex_stats_t stats;
 } mutex_t;
 
+// Software timer: the timer service task calls callback(timer, arg) once period_ms after the timer is
+// started, or every period_ms until it is stopped. Timers take no task slot of their own.
+struct soft_timer;
+typedef void (*soft_timer_callback_t)(struct soft_timer *timer, void *arg);
+
+typedef struct soft_timer {
+    wheel_entry_t entry; // On the timer service's wheel while running, due at the next expiry
+    soft_timer_callback_t callback;
+    void *arg;
+    uint32_t period_ms;
+    bool periodic;
+    uint32_t expiries; // Callbacks run so far
+} soft_timer_t;
+
+// Timer service: one stackful task whose job never ends. It runs the callbacks of expired timers,
+// then sleeps until the next expiry or until a timer is started that expires sooner.
+typedef struct {
+    volatile bool lock; // Guards the wheel, waiters and wake_us
+    release_wheel_t wheel; // Running timers; a zeroed wheel is empty
+    wait_list_t waiters; // The service task while it sleeps
+    uint64_t wake_us; // When the sleeping service wakes by itself (WAIT_FOREVER_US = never)
+    int task; // Service task index (-1 = none)
+} timer_service_t;
+
+// Longest time a task holds a ceiling mutex, for admission control
+typedef struct {
+    int task;
+    mutex_t *mutex;
+    uint32_t length_us;
+} critical_section_t;
+
 // Task list and count
 task_t task_list[MAX_TASKS];
 int task_count = 0;
 
+// Per-core queues and main loop state
+core_t cores[NUM_CORES];
+volatile bool scheduler_running = false; // Between scheduler_start() and scheduler_stop()
+uint64_t scheduler_start_time = 0;
+
+// Stacks of the stackful tasks
+uint8_t task_stacks[MAX_STACKS][TASK_STACK_SIZE] __attribute__((aligned(16)));
+int stack_count = 0;
+
 // Global variables
-queue_t task_queue = { .front = 0, .rear = 0, .size = 0 };
-event_flag_t event_flag = { .flag = false };
+QUEUE_DEFINE(task_queue, int, 16);
 semaphore_t semaphore;
-mutex_t mutex = { .locked = false };
-
-// Current running task (for preemptive scheduling)
-volatile int current_task = -1;
+mutex_t mutex = { .owner = 0 };
+uint32_t mutex_spin_limit = MUTEX_SPIN_LIMIT;
+critical_section_t critical_sections[MAX_CRITICAL_SECTIONS];
+timer_service_t timer_service = { .task = -1 };
+soft_timer_t heartbeat_timer;
+int critical_section_count = 0;
 
 // Scheduler type
 typedef enum {
     SCHEDULER_RR,       // Round Robin
     SCHEDULER_FCFS,     // First-Come-First-Served
     SCHEDULER_PRIORITY, // Priority Scheduling
-    SCHEDULER_PREEMPTIVE // Preemptive Scheduling
+    SCHEDULER_PREEMPTIVE, // Preemptive Scheduling
+    SCHEDULER_EDF       // Earliest-Deadline-First (preemptive)
 } scheduler_type_t;
 
 scheduler_type_t scheduler_type = SCHEDULER_RR; // Default scheduler
+bool admission_control = false; // Check schedulability in scheduler_add_task()
+bool work_stealing = false; // Idle cores take ready jobs from busy ones
 
 // Timer group and timer index for preemptive scheduling
 #define TIMER_GROUP TIMER_GROUP_0
-#define TIMER_IDX TIMER_0
+#define TIMER_IDX ((timer_idx_t)port_core_id()) // One tick timer per core
+#define TICK_PERIOD_US 1000 // Preemption check interval
+#define ALARM_GROUP TIMER_GROUP_1 // One wake alarm per core, ending idle waits on time and carrying the IPI
 
 // Function prototypes
-void queue_push(queue_t *queue, void *item);
-void *queue_pop(queue_t *queue);
-void event_flag_set(event_flag_t *flag);
-void event_flag_clear(event_flag_t *flag);
-bool event_flag_check(event_flag_t *flag);
+uint32_t event_group_set(event_group_t *group, uint32_t bits);
+uint32_t event_group_set_from_isr(event_group_t *group, uint32_t bits, bool *woken);
+uint32_t event_group_clear(event_group_t *group, uint32_t bits);
+uint32_t event_group_get(event_group_t *group);
+uint32_t event_group_wait(event_group_t *group, uint32_t mask, bool all, bool clear_on_exit, uint32_t timeout_ms);
+bool soft_timer_create(soft_timer_t *timer, uint32_t period_ms, bool periodic, soft_timer_callback_t callback, void *arg);
+bool soft_timer_start(soft_timer_t *timer);
+bool soft_timer_stop(soft_timer_t *timer);
+void soft_timer_reset(soft_timer_t *timer);
 void semaphore_init(semaphore_t *sem, int value);
+bool queue_set_add_queue(queue_set_t *set, queue_t *queue);
+bool queue_set_add_semaphore(queue_set_t *set, semaphore_t *sem);
+void *queue_set_select(queue_set_t *set, uint32_t timeout_ms);
 void semaphore_wait(semaphore_t *sem);
+bool semaphore_try_wait(semaphore_t *sem);
 void semaphore_signal(semaphore_t *sem);
+bool semaphore_signal_from_isr(semaphore_t *sem);
+void mutex_init_ceiling(mutex_t *mutex, int ceiling);
 void mutex_lock(mutex_t *mutex);
+bool mutex_try_lock(mutex_t *mutex);
 void mutex_unlock(mutex_t *mutex);
-void scheduler_add_task(task_func_t func, void *param, uint32_t interval_ms, int priority);
+void mutex_set_spin_limit(uint32_t checks);
+mutex_stats_t mutex_get_stats(const mutex_t *mutex);
+void ready_list_push(core_t *core, int index);
+void ready_list_remove(core_t *core, int index);
+int ready_list_highest(core_t *core);
+void task_heap_push(task_heap_t *heap, int index);
+int task_heap_top(task_heap_t *heap);
+void task_heap_remove(task_heap_t *heap, int index);
+void release_wheel_init(release_wheel_t *wheel);
+void release_wheel_push(release_wheel_t *wheel, wheel_entry_t *entry);
+void release_wheel_remove(release_wheel_t *wheel, wheel_entry_t *entry);
+wheel_entry_t *release_wheel_expire(release_wheel_t *wheel, uint64_t now);
+uint64_t release_wheel_next_time(release_wheel_t *wheel);
+void release_heap_init(release_heap_t *heap);
+void release_heap_push(release_heap_t *heap, wheel_entry_t *entry);
+void release_heap_remove(release_heap_t *heap, wheel_entry_t *entry);
+wheel_entry_t *release_heap_expire(release_heap_t *heap, uint64_t now);
+uint64_t release_heap_next_time(release_heap_t *heap);
+bool steal_deque_push(steal_deque_t *deque, int index);
+bool steal_deque_pop(steal_deque_t *deque, int *index);
+int steal_deque_steal(steal_deque_t *deque);
+void ready_push(core_t *core, int index);
+void ready_remove(core_t *core, int index);
+int ready_highest(core_t *core);
+admit_result_t scheduler_add_task(task_func_t func, void *param, uint32_t interval_ms, int priority, uint32_t wcet_us);
+admit_result_t scheduler_add_coroutine(coroutine_func_t func, void *param, uint32_t interval_ms, int priority, uint32_t wcet_us);
+void task_delay_ms(uint32_t ms);
+void task_delay_until(uint64_t wake_us);
+void task_yield(void);
 void scheduler_remove_task(int index);
+void scheduler_set_overrun_policy(int index, overrun_policy_t policy);
+admit_result_t scheduler_set_deadline(int index, uint32_t deadline_ms);
+admit_result_t scheduler_set_affinity(int index, int core);
+admit_result_t scheduler_set_critical_section(int index, mutex_t *mutex, uint32_t length_us);
+void scheduler_set_admission_control(bool enabled);
+void scheduler_set_work_stealing(bool enabled);
+void scheduler_set_migration(int index, migration_t migration);
+void scheduler_set_triggered(int index);
+void scheduler_activate_on_queue(int index, queue_t *queue);
+void scheduler_activate_on_semaphore(int index, semaphore_t *sem);
+void scheduler_activate_on_event(int index, event_group_t *group, uint32_t mask);
+void scheduler_activate(int index);
+bool scheduler_activate_from_isr(int index);
+admit_result_t scheduler_add_timer_service(int priority, uint32_t interval_ms, uint32_t wcet_us);
+bool scheduler_schedulable(void);
 void scheduler_setup(scheduler_type_t type);
+void scheduler_release(core_t *core, uint64_t now);
+void scheduler_dispatch(core_t *core, int index);
 void scheduler_run(void);
+uint64_t scheduler_next_wakeup(void);
+void scheduler_start(void);
+void scheduler_stop(void);
+void scheduler_log_stats(void);
+void scheduler_yield_from_isr(void);
 void IRAM_ATTR timer_isr(void *arg);
+void IRAM_ATTR scheduler_ipi_isr(void);
+void port_timer_start(uint64_t period_us, void (*isr)(void *));
+void IRAM_ATTR port_timer_ack(void);
+void port_core_setup(void (*ipi_isr)(void));
+void port_core_exit(void);
+void port_core_start(int core, void (*entry)(int));
+void port_core_join(int core);
+void IRAM_ATTR port_ipi_send(int core);
+void port_context_init(port_context_t *context, uint8_t *stack, size_t size, void (*entry)(void));
+void IRAM_ATTR port_context_switch(port_context_t *from, port_context_t *to);
+void IRAM_ATTR port_context_switch_from_isr(port_context_t *from, port_context_t *to);
+void port_wait_until(uint64_t deadline_us, volatile bool *wake);
+bool port_running(void);
 void producer_task(void *param);
 void consumer_task(void *param);
 void critical_task(void *param);
-void semaphore_task(void *param);
+co_status_t semaphore_task(coroutine_t *co, void *param);
+void heartbeat_callback(soft_timer_t *timer, void *arg);
 void app_main(void);
 
-// Queue functions
-void queue_push(queue_t *queue, void *item) {
-    if (queue->size < MAX_QUEUE_SIZE) {
-        queue->items[queue->rear] = item;
-        queue->rear = (queue->rear + 1) % MAX_QUEUE_SIZE;
-        queue->size++;
+// Copy one queue item. Constant sizes compile to a single load and store instead of a memcpy call.
+// Inlined next to a smaller item, the cases for other sizes cannot run but GCC still bounds-checks them.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Warray-bounds"
+#pragma GCC diagnostic ignored "-Wstringop-overflow"
+static inline void IRAM_ATTR queue_copy(void *to, const void *from, uint32_t size) {
+    switch (size) {
+        case 1: memcpy(to, from, 1); break;
+        case 2: memcpy(to, from, 2); break;
+        case 4: memcpy(to, from, 4); break;
+        case 8: memcpy(to, from, 8); break;
+        default: memcpy(to, from, size); break;
+    }
+}
+#pragma GCC diagnostic pop
+
+// Queue functions. The release store of a counter publishes the slot write (or read) before it.
+// Use a caller-provided buffer of capacity * item_size bytes. False unless capacity is a power of two.
+bool queue_init(queue_t *queue, void *buffer, uint32_t item_size, uint32_t capacity) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) return false;
+    queue->head = 0;
+    queue->tail_seen = 0;
+    queue->tail = 0;
+    queue->head_seen = 0;
+    queue->buffer = buffer;
+    queue->item_size = item_size;
+    queue->capacity = capacity;
+    queue->lock = false;
+    queue->receiver_waiting = false;
+    queue->sender_waiting = false;
+    queue->receivers.head = 0;
+    queue->senders.head = 0;
+    queue->set = NULL;
+    queue->activates = 0;
+    return true;
+}
+
+// Producer side: copy *item in; false if the queue is full
+bool IRAM_ATTR queue_push(queue_t *queue, const void *item) {
+    uint32_t tail = queue->tail;
+
+    if (tail - queue->head_seen == queue->capacity) {
+        queue->head_seen = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        if (tail - queue->head_seen == queue->capacity) return false;
     }
+    queue_copy(queue->buffer + (tail & (queue->capacity - 1)) * queue->item_size, item, queue->item_size);
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
 }
 
-void *queue_pop(queue_t *queue) {
-    if (queue->size > 0) {
-        void *item = queue->items[queue->front];
-        queue->front = (queue->front + 1) % MAX_QUEUE_SIZE;
-        queue->size--;
-        return item;
+// Consumer side: copy the oldest item out to *item; false if the queue is empty
+bool IRAM_ATTR queue_pop(queue_t *queue, void *item) {
+    uint32_t head = queue->head;
+
+    if (head == queue->tail_seen) {
+        queue->tail_seen = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        if (head == queue->tail_seen) return false;
     }
-    return NULL;
+    queue_copy(item, queue->buffer + (head & (queue->capacity - 1)) * queue->item_size, queue->item_size);
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Copy n items between a queue's ring slots from `start` on and a flat array, in at most two pieces
+static inline void IRAM_ATTR queue_copy_slots(queue_t *queue, uint32_t start, void *items, uint32_t n, bool push) {
+    uint32_t slot = start & (queue->capacity - 1);
+    uint32_t first = queue->capacity - slot < n ? queue->capacity - slot : n;
+    uint8_t *ring = queue->buffer + slot * queue->item_size;
+    uint8_t *flat = items;
+
+    if (n == 1) {
+        queue_copy(push ? ring : flat, push ? flat : ring, queue->item_size);
+        return;
+    }
+    if (push) {
+        memcpy(ring, flat, first * queue->item_size);
+    } else {
+        memcpy(flat, ring, first * queue->item_size);
+    }
+    if (first < n) { // Wrapped around
+        if (push) {
+            memcpy(queue->buffer, flat + first * queue->item_size, (n - first) * queue->item_size);
+        } else {
+            memcpy(flat + first * queue->item_size, queue->buffer, (n - first) * queue->item_size);
+        }
+    }
+}
+
+// Producer side: copy in as many of the n items as fit and publish them together. Returns how
+// many were pushed.
+uint32_t IRAM_ATTR queue_push_n(queue_t *queue, const void *items, uint32_t n) {
+    uint32_t tail = queue->tail;
+    uint32_t space = queue->capacity - (tail - queue->head_seen);
+
+    if (space < n) {
+        queue->head_seen = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        space = queue->capacity - (tail - queue->head_seen);
+        n = space < n ? space : n;
+    }
+    if (n == 0) return 0;
+    queue_copy_slots(queue, tail, (void *)items, n, true);
+    __atomic_store_n(&queue->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+// Consumer side: copy out up to n of the oldest items and release their slots together. Returns how
+// many were popped.
+uint32_t IRAM_ATTR queue_pop_n(queue_t *queue, void *items, uint32_t n) {
+    uint32_t head = queue->head;
+    uint32_t available = queue->tail_seen - head;
+
+    if (available < n) {
+        queue->tail_seen = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        available = queue->tail_seen - head;
+        n = available < n ? available : n;
+    }
+    if (n == 0) return 0;
+    queue_copy_slots(queue, head, items, n, false);
+    __atomic_store_n(&queue->head, head + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+// Items in the queue: at least this many for the consumer, at most this many for the producer
+uint32_t IRAM_ATTR queue_count(queue_t *queue) {
+    uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) - head;
+}
+
+// Spinlock of a synchronization object, taken with interrupts disabled. Objects are locked before
+// any core.
+static inline void IRAM_ATTR spin_lock(volatile bool *lock) {
+    while (__atomic_test_and_set(lock, __ATOMIC_ACQUIRE));
+}
+
+static inline void IRAM_ATTR spin_unlock(volatile bool *lock) {
+    __atomic_clear(lock, __ATOMIC_RELEASE);
+}
+
+// Wait list functions (object locked)
+static void wait_list_insert(wait_list_t *list, int index) {
+    int *link = &list->head;
+
+    while (*link != 0 && task_list[*link - 1].priority <= task_list[index].priority) {
+        link = &task_list[*link - 1].next_waiter;
+    }
+    task_list[index].next_waiter = *link;
+    *link = index + 1;
+}
+
+// Highest-priority waiter, or -1
+static int IRAM_ATTR wait_list_pop(wait_list_t *list) {
+    if (list->head == 0) return -1;
+
+    int index = list->head - 1;
+    list->head = task_list[index].next_waiter;
+    task_list[index].next_waiter = 0;
+    return index;
 }
 
-// Event flag functions
-void event_flag_set(event_flag_t *flag) {
-    flag->flag = true;
+static void wait_list_remove(wait_list_t *list, int index) {
+    int *link = &list->head;
+
+    while (*link != 0 && *link != index + 1) {
+        link = &task_list[*link - 1].next_waiter;
+    }
+    if (*link != 0) {
+        *link = task_list[index].next_waiter;
+        task_list[index].next_waiter = 0;
+    }
 }
 
-void event_flag_clear(event_flag_t *flag) {
-    flag->flag = false;
+// Blocking, implemented with the scheduler below. A wait ends at an absolute wake_us, which can be
+// any time including 0, or never.
+#define WAIT_FOREVER_US UINT64_MAX
+static int task_current(void);
+static bool task_running_elsewhere(int index);
+static bool task_block(wait_list_t *waiters, volatile bool *lock, port_irq_state_t irq, uint64_t wake_us);
+static bool task_wake(int index);
+static bool task_activate(int index);
+static void task_set_priority(int index, int priority);
+static void task_yield_if_preempted(void);
+
+// Wake the task blocked behind a waiting flag (see the blocking queue functions), if the flag is up.
+// The fence pairs with the one the waiter makes between raising the flag and its last check.
+// Returns true if it woke a task.
+static bool IRAM_ATTR waiting_flag_wake(volatile bool *waiting, volatile bool *lock, wait_list_t *waiters) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!*waiting) return false;
+
+    port_irq_state_t irq = port_irq_disable();
+    spin_lock(lock);
+    int index = wait_list_pop(waiters);
+    bool woken = index != -1 && task_wake(index); // False if it timed out meanwhile
+    spin_unlock(lock);
+    port_irq_restore(irq);
+    return woken;
 }
 
-bool event_flag_check(event_flag_t *flag) {
-    return flag->flag;
+// A member of `set` (if any) just became ready: wake a task selecting on it
+static bool IRAM_ATTR queue_set_notify(queue_set_t *set) {
+    return set != NULL && waiting_flag_wake(&set->waiting, &set->lock, &set->waiters);
 }
 
 // Semaphore functions
 void semaphore_init(semaphore_t *sem, int value) {
     sem->count = value;
+    sem->lock = false;
+    sem->handoffs = 0;
+    sem->waiters.head = 0;
+    sem->set = NULL;
+    sem->activates = 0;
 }
 
+// Take the semaphore, blocking until it is given if it is taken. Only stackful tasks block; the main
+// loop and coroutines poll instead.
 void semaphore_wait(semaphore_t *sem) {
-    while (sem->count <= 0);
-    sem->count--;
+    if (semaphore_try_wait(sem)) return;
+
+    port_irq_state_t irq = port_irq_disable();
+    if (task_current() == -1) {
+        port_irq_restore(irq);
+        while (!semaphore_try_wait(sem));
+        return;
+    }
+    if (__atomic_fetch_sub(&sem->count, 1, __ATOMIC_ACQUIRE) > 0) { // Given back meanwhile
+        port_irq_restore(irq);
+        return;
+    }
+    spin_lock(&sem->lock);
+    if (sem->handoffs > 0) { // A give already found this task waiting
+        sem->handoffs--;
+        spin_unlock(&sem->lock);
+        port_irq_restore(irq);
+        return;
+    }
+    task_block(&sem->waiters, &sem->lock, irq, WAIT_FOREVER_US); // The give hands the count over
+}
+
+// Take the semaphore only if that needs no waiting. Never blocks, so safe in an ISR.
+bool IRAM_ATTR semaphore_try_wait(semaphore_t *sem) {
+    int count = sem->count;
+    while (count > 0) {
+        if (__atomic_compare_exchange_n(&sem->count, &count, count - 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// With interrupts disabled, once a give found count below zero: hand the count to the highest-priority
+// waiter and make it ready. Returns the woken task, or -1.
+static int IRAM_ATTR semaphore_hand_over(semaphore_t *sem) {
+    int woken = -1;
+
+    spin_lock(&sem->lock);
+    while (woken == -1) {
+        int index = wait_list_pop(&sem->waiters);
+        if (index == -1) {
+            sem->handoffs++; // The waiter is on its way to the wait list
+            break;
+        }
+        if (task_wake(index)) {
+            woken = index;
+        } else if (__atomic_fetch_add(&sem->count, 1, __ATOMIC_RELEASE) >= 0) {
+            break; // Removed while blocked: undo its take and offer the count again
+        }
+    }
+    spin_unlock(&sem->lock);
+    return woken;
 }
 
+// Give the semaphore, handing it to the highest-priority waiter if there is one
 void semaphore_signal(semaphore_t *sem) {
-    sem->count++;
+    if (__atomic_fetch_add(&sem->count, 1, __ATOMIC_RELEASE) >= 0) { // Nobody waiting
+        bool woken = queue_set_notify(sem->set);
+        if (sem->activates != 0) {
+            woken |= task_activate(sem->activates - 1);
+        }
+        if (woken) {
+            task_yield_if_preempted();
+        }
+        return;
+    }
+
+    port_irq_state_t irq = port_irq_disable();
+    int woken = semaphore_hand_over(sem);
+    port_irq_restore(irq);
+    if (woken != -1) {
+        task_yield_if_preempted();
+    }
 }
 
-// Mutex functions
-void mutex_lock(mutex_t *mutex) {
-    while (__atomic_test_and_set(&mutex->locked, __ATOMIC_ACQUIRE));
+// semaphore_signal() for interrupt handlers. Returns true if it woke a task; end the handler with
+// scheduler_yield_from_isr() so that, in preemptive modes, the task runs at once if it should.
+bool IRAM_ATTR semaphore_signal_from_isr(semaphore_t *sem) {
+    if (__atomic_fetch_add(&sem->count, 1, __ATOMIC_RELEASE) >= 0) {
+        bool woken = queue_set_notify(sem->set);
+        if (sem->activates != 0) {
+            woken |= task_activate(sem->activates - 1);
+        }
+        return woken;
+    }
+
+    port_irq_state_t irq = port_irq_disable();
+    int woken = semaphore_hand_over(sem);
+    port_irq_restore(irq);
+    return woken != -1;
 }
 
-void mutex_unlock(mutex_t *mutex) {
-    __atomic_clear(&mutex->locked, __ATOMIC_RELEASE);
+// Blocking queue functions. A side about to block sets its waiting flag, then checks the queue again;
+// the other side checks the flag after each push or pop. A full fence on both sides means at least
+// one of them sees the other, so a wakeup is never lost.
+
+// Absolute end of a wait of timeout_ms (WAIT_FOREVER_US = none)
+static uint64_t queue_wake_time(uint32_t timeout_ms) {
+    return timeout_ms == QUEUE_WAIT_FOREVER ? WAIT_FOREVER_US : esp_timer_get_time() + (uint64_t)timeout_ms * 1000;
 }
 
-// Task management
-void scheduler_add_task(task_func_t func, void *param, uint32_t interval_ms, int priority) {
-    if (task_count < MAX_TASKS) {
-        task_list[task_count].func = func;
-        task_list[task_count].param = param;
-        task_list[task_count].interval_ms = interval_ms;
-        task_list[task_count].last_run = 0;
-        task_list[task_count].state = TASK_READY;
-        task_list[task_count].priority = priority;
-        task_count++;
-    } else {
-        ESP_LOGW("Scheduler", "Max tasks reached");
+// After a push: wake the task blocked in queue_receive() or selecting on the queue's set, and activate
+// the task bound to the queue. Returns true if it woke a task.
+static bool IRAM_ATTR queue_wake_receiver(queue_t *queue) {
+    bool woken = waiting_flag_wake(&queue->receiver_waiting, &queue->lock, &queue->receivers);
+    woken |= queue_set_notify(queue->set);
+    if (queue->activates != 0) {
+        woken |= task_activate(queue->activates - 1);
     }
+    return woken;
 }
 
-void scheduler_remove_task(int index) {
-    if (index >= 0 && index < task_count) {
-        task_list[index].state = TASK_TERMINATED;
+// After a push (receiving = true) or a pop: wake the task blocked on the other side, if any
+static void queue_wake(queue_t *queue, bool receiving) {
+    bool woken;
+
+    if (receiving) {
+        woken = queue_wake_receiver(queue);
+    } else {
+        woken = waiting_flag_wake(&queue->sender_waiting, &queue->lock, &queue->senders);
+    }
+    if (woken) {
+        task_yield_if_preempted();
     }
 }
 
-// Scheduler setup
-void scheduler_setup(scheduler_type_t type) {
-    scheduler_type = type;
+// Block the calling task until the other side wakes it or wake_us passes, unless the queue is no
+// longer empty (receiving) or full by the time its flag is up. Returns false once wake_us has passed.
+// Outside a stackful task it returns at once, so the caller polls.
+static bool queue_wait(queue_t *queue, bool receiving, uint64_t wake_us) {
+    volatile bool *waiting = receiving ? &queue->receiver_waiting : &queue->sender_waiting;
+    wait_list_t *waiters = receiving ? &queue->receivers : &queue->senders;
 
-    // Configure timer for preemptive scheduling
-    if (type == SCHEDULER_PREEMPTIVE) {
-        timer_config_t timer_config = {
-            .divider = 80, // 1 MHz timer (80 MHz / 80)
-            .counter_dir = TIMER_COUNT_UP,
-            .counter_en = TIMER_PAUSE,
-            .alarm_en = TIMER_ALARM_EN,
-            .auto_reload = TIMER_AUTORELOAD_EN
-        };
-        timer_init(TIMER_GROUP, TIMER_IDX, &timer_config);
-        timer_set_counter_value(TIMER_GROUP, TIMER_IDX, 0);
-        timer_set_alarm_value(TIMER_GROUP, TIMER_IDX, 1000000); // 1 second interval
-        timer_enable_intr(TIMER_GROUP, TIMER_IDX);
-        timer_isr_register(TIMER_GROUP, TIMER_IDX, timer_isr, NULL, ESP_INTR_FLAG_IRAM, NULL);
-        timer_start(TIMER_GROUP, TIMER_IDX);
-    }
-}
-
-// Scheduler run function
-void scheduler_run(void) {
-    uint64_t now = esp_timer_get_time() / 1000; // Get time in milliseconds
+    if (wake_us != WAIT_FOREVER_US && esp_timer_get_time() >= wake_us) return false;
 
-    switch (scheduler_type) {
-        case SCHEDULER_RR: {
-            static int current_task = 0;
-            if (task_count == 0) return;
-
-            if (task_list[current_task].state != TASK_TERMINATED &&
-                now - task_list[current_task].last_run >= task_list[current_task].interval_ms) {
-                task_list[current_task].state = TASK_RUNNING;
-                task_list[current_task].func(task_list[current_task].param);
-                task_list[current_task].last_run = now;
-                task_list[current_task].state = TASK_READY;
-            }
-            current_task = (current_task + 1) % task_count;
-            break;
-        }
+    port_irq_state_t irq = port_irq_disable();
+    int self = task_current();
+    if (self == -1) {
+        port_irq_restore(irq);
+        return true;
+    }
+    spin_lock(&queue->lock);
+    *waiting = true;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t count = queue_count(queue);
+    if (receiving ? count == 0 : count == queue->capacity) {
+        task_block(waiters, &queue->lock, irq, wake_us);
+        irq = port_irq_disable();
+        spin_lock(&queue->lock);
+        wait_list_remove(waiters, self); // Still listed if the wait timed out
+    }
+    *waiting = false;
+    spin_unlock(&queue->lock);
+    port_irq_restore(irq);
+    return true;
+}
 
-        case SCHEDULER_FCFS: {
-            for (int i = 0; i < task_count; i++) {
-                if (task_list[i].state != TASK_TERMINATED &&
-                    now - task_list[i].last_run >= task_list[i].interval_ms) {
-                    task_list[i].state = TASK_RUNNING;
-                    task_list[i].func(task_list[i].param);
-                    task_list[i].last_run = now;
-                    task_list[i].state = TASK_READY;
-                    break; // Run the first ready task and exit
-                }
-            }
-            break;
-        }
+// Producer side: push *item, blocking for up to timeout_ms (QUEUE_WAIT_FOREVER, or 0 to not wait)
+// while the queue is full, and wake a consumer blocked in queue_receive(). False on timeout.
+// Not from an ISR.
+bool queue_send(queue_t *queue, const void *item, uint32_t timeout_ms) {
+    uint64_t wake_us = queue_wake_time(timeout_ms);
 
-        case SCHEDULER_PRIORITY: {
-            int highest_priority_task = -1;
-            int highest_priority = INT_MAX;
+    while (!queue_push(queue, item)) {
+        if (!queue_wait(queue, false, wake_us)) return false;
+    }
+    queue_wake(queue, true);
+    return true;
+}
 
-            for (int i = 0; i < task_count; i++) {
-                if (task_list[i].state != TASK_TERMINATED &&
-                    now - task_list[i].last_run >= task_list[i].interval_ms &&
-                    task_list[i].priority < highest_priority) {
-                    highest_priority = task_list[i].priority;
-                    highest_priority_task = i;
-                }
-            }
+// Producer side from an ISR: push *item without waiting and wake the consumer as queue_send() does.
+// False if the queue is full. Sets *woken if it woke a task; end the handler with
+// scheduler_yield_from_isr() then.
+bool IRAM_ATTR queue_send_from_isr(queue_t *queue, const void *item, bool *woken) {
+    *woken = false;
+    if (!queue_push(queue, item)) return false;
+    *woken = queue_wake_receiver(queue);
+    return true;
+}
 
-            if (highest_priority_task != -1) {
-                task_list[highest_priority_task].state = TASK_RUNNING;
-                task_list[highest_priority_task].func(task_list[highest_priority_task].param);
-                task_list[highest_priority_task].last_run = now;
-                task_list[highest_priority_task].state = TASK_READY;
-            }
-            break;
-        }
+// Consumer side: pop into *item, blocking for up to timeout_ms while the queue is empty, and wake a
+// producer blocked in queue_send(). False on timeout. Not from an ISR.
+bool queue_receive(queue_t *queue, void *item, uint32_t timeout_ms) {
+    uint64_t wake_us = queue_wake_time(timeout_ms);
 
-        case SCHEDULER_PREEMPTIVE: {
-            // Preemptive scheduling is handled in the timer ISR
-            break;
-        }
+    while (!queue_pop(queue, item)) {
+        if (!queue_wait(queue, true, wake_us)) return false;
+    }
+    queue_wake(queue, false);
+    return true;
+}
 
-        default:
-            break;
+// MPMC queue functions. A side claims a position with a CAS on its counter, then hands the slot to
+// the other side with a release store of the slot's sequence. Tasks block on it like on a queue_t,
+// except that any number of them can wait on each side.
+static inline uint32_t *IRAM_ATTR mpmc_slot(mpmc_queue_t *queue, uint32_t pos) {
+    return (uint32_t *)(queue->slots + (pos & (queue->capacity - 1)) * queue->slot_size);
+}
+
+void mpmc_queue_init(mpmc_queue_t *queue) {
+    for (uint32_t i = 0; i < queue->capacity; i++) {
+        *mpmc_slot(queue, i) = i;
     }
+    queue->push_pos = 0;
+    queue->pop_pos = 0;
+    queue->lock = false;
+    queue->receiver_waiting = false;
+    queue->sender_waiting = false;
+    queue->receivers.head = 0;
+    queue->senders.head = 0;
 }
 
-// Timer ISR for preemptive scheduling
-void IRAM_ATTR timer_isr(void *arg) {
-    // Check for higher-priority tasks
-    int highest_priority_task = -1;
-    int highest_priority = INT_MAX;
-    uint64_t now = esp_timer_get_time() / 1000;
+static bool IRAM_ATTR mpmc_queue_insert(mpmc_queue_t *queue, const void *item) {
+    uint32_t pos = __atomic_load_n(&queue->push_pos, __ATOMIC_RELAXED);
 
-    for (int i = 0; i < task_count; i++) {
-        if (task_list[i].state != TASK_TERMINATED &&
-            now - task_list[i].last_run >= task_list[i].interval_ms &&
-            task_list[i].priority < highest_priority) {
-            highest_priority = task_list[i].priority;
-            highest_priority_task = i;
+    while (1) {
+        uint32_t *sequence = mpmc_slot(queue, pos);
+        int32_t diff = (int32_t)(__atomic_load_n(sequence, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->push_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                queue_copy((uint8_t *)sequence + queue->item_offset, item, queue->item_size);
+                __atomic_store_n(sequence, pos + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // Still holds the item from one lap ago
+        } else {
+            pos = __atomic_load_n(&queue->push_pos, __ATOMIC_RELAXED);
         }
     }
+}
+
+static bool IRAM_ATTR mpmc_queue_remove(mpmc_queue_t *queue, void *item) {
+    uint32_t pos = __atomic_load_n(&queue->pop_pos, __ATOMIC_RELAXED);
 
-    // If a higher-priority task is found, switch to it
-    if (highest_priority_task != -1 && highest_priority_task != current_task) {
-        if (current_task != -1) {
-            task_list[current_task].state = TASK_READY; // Put the current task back to ready state
+    while (1) {
+        uint32_t *sequence = mpmc_slot(queue, pos);
+        int32_t diff = (int32_t)(__atomic_load_n(sequence, __ATOMIC_ACQUIRE) - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->pop_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                queue_copy(item, (uint8_t *)sequence + queue->item_offset, queue->item_size);
+                __atomic_store_n(sequence, pos + queue->capacity, __ATOMIC_RELEASE);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = __atomic_load_n(&queue->pop_pos, __ATOMIC_RELAXED);
         }
-        current_task = highest_priority_task;
-        task_list[current_task].state = TASK_RUNNING;
-        task_list[current_task].func(task_list[current_task].param);
-        task_list[current_task].last_run = now;
-        task_list[current_task].state = TASK_READY;
     }
+}
 
-    // Clear the interrupt
-    timer_group_clr_intr_status_in_isr(TIMER_GROUP, TIMER_IDX);
-    timer_group_enable_alarm_in_isr(TIMER_GROUP, TIMER_IDX);
+// True if a pop (receiving) or a push would find its slot ready now
+static bool mpmc_queue_ready(mpmc_queue_t *queue, bool receiving) {
+    uint32_t pos = receiving ? queue->pop_pos : queue->push_pos;
+    return (int32_t)(__atomic_load_n(mpmc_slot(queue, pos), __ATOMIC_ACQUIRE) - pos - receiving) >= 0;
 }
 
-// Task functions
-void producer_task(void *param) {
-    static int data = 0;
-    queue_push(&task_queue, (void *)(uintptr_t)data);
-    ESP_LOGI("Producer", "Produced: %d", data);
-    data++;
-    event_flag_set(&event_flag);
+// After a push (receiving = true) or a pop: wake one task blocked on the other side, if any
+static bool IRAM_ATTR mpmc_queue_wake(mpmc_queue_t *queue, bool receiving) {
+    if (receiving) {
+        return waiting_flag_wake(&queue->receiver_waiting, &queue->lock, &queue->receivers);
+    }
+    return waiting_flag_wake(&queue->sender_waiting, &queue->lock, &queue->senders);
 }
 
-void consumer_task(void *param) {
-    if (event_flag_check(&event_flag)) {
-        int data = (int)(uintptr_t)queue_pop(&task_queue);
-        ESP_LOGI("Consumer", "Consumed: %d", data);
-        event_flag_clear(&event_flag);
+// Block the calling task until the other side wakes it, unless the queue is no longer empty
+// (receiving) or full by the time its flag is up. The flag stays up while other tasks wait. Outside a
+// stackful task it returns at once, so the caller spins.
+static void mpmc_queue_wait(mpmc_queue_t *queue, bool receiving) {
+    volatile bool *waiting = receiving ? &queue->receiver_waiting : &queue->sender_waiting;
+    wait_list_t *waiters = receiving ? &queue->receivers : &queue->senders;
+
+    port_irq_state_t irq = port_irq_disable();
+    if (task_current() == -1) {
+        port_irq_restore(irq);
+        return;
+    }
+    spin_lock(&queue->lock);
+    *waiting = true;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Pairs with the one in waiting_flag_wake()
+    if (!mpmc_queue_ready(queue, receiving)) {
+        task_block(waiters, &queue->lock, irq, WAIT_FOREVER_US); // The waker takes it off the list
+        irq = port_irq_disable();
+        spin_lock(&queue->lock);
     }
+    *waiting = waiters->head != 0;
+    spin_unlock(&queue->lock);
+    port_irq_restore(irq);
 }
 
-void critical_task(void *param) {
-    mutex_lock(&mutex);
-    ESP_LOGI("Critical", "In critical section");
-    esp_rom_delay_us(500 * 1000); // Delay for 500ms
-    mutex_unlock(&mutex);
+// False if the queue is full. Never waits, so it is safe in an ISR; a task it wakes in mpmc_queue_pop()
+// runs at the next scheduling point, at once if the handler ends with scheduler_yield_from_isr().
+bool IRAM_ATTR mpmc_queue_try_push(mpmc_queue_t *queue, const void *item) {
+    if (!mpmc_queue_insert(queue, item)) return false;
+    mpmc_queue_wake(queue, true);
+    return true;
 }
 
-void semaphore_task(void *param) {
-    semaphore_wait(&semaphore);
-    ESP_LOGI("Semaphore", "Accessing shared resource");
-    esp_rom_delay_us(500 * 1000); // Delay for 500ms
-    semaphore_signal(&semaphore);
+// False if the queue is empty (or its oldest item is still being written). Safe in an ISR, as
+// mpmc_queue_try_push().
+bool IRAM_ATTR mpmc_queue_try_pop(mpmc_queue_t *queue, void *item) {
+    if (!mpmc_queue_remove(queue, item)) return false;
+    mpmc_queue_wake(queue, false);
+    return true;
 }
 
-// Main application
-void app_main(void) {
-    printf("Task scheduler example\n");
-    semaphore_init(&semaphore, 1);
+// Push, blocking the calling task while the queue is full, and wake a task blocked in mpmc_queue_pop().
+// The main loop busy-waits instead. Not from an ISR.
+void mpmc_queue_push(mpmc_queue_t *queue, const void *item) {
+    while (!mpmc_queue_insert(queue, item)) {
+        mpmc_queue_wait(queue, false);
+    }
+    if (mpmc_queue_wake(queue, true)) {
+        task_yield_if_preempted();
+    }
+}
 
-    // Add tasks with priorities
-    scheduler_add_task(producer_task, NULL, 1000, 2);
-    scheduler_add_task(consumer_task, NULL, 1500, 1);
-    scheduler_add_task(critical_task, NULL, 2000, 3);
-    scheduler_add_task(semaphore_task, NULL, 2500, 4);
+// Pop, blocking while the queue is empty (as mpmc_queue_push())
+void mpmc_queue_pop(mpmc_queue_t *queue, void *item) {
+    while (!mpmc_queue_remove(queue, item)) {
+        mpmc_queue_wait(queue, true);
+    }
+    if (mpmc_queue_wake(queue, false)) {
+        task_yield_if_preempted();
+    }
+}
 
-    // Set up the scheduler (choose the type here)
-    // scheduler_setup(SCHEDULER_PREEMPTIVE);
-    scheduler_setup(SCHEDULER_PRIORITY);
+// Queue set functions. Add members before any task selects on the set, and after their init.
 
+// False if the set is full or the member already belongs to a set
+static bool queue_set_add(queue_set_t *set, void *object, struct queue_set **member_set, bool semaphore) {
+    if (set->count == QUEUE_SET_MAX_MEMBERS || *member_set != NULL) return false;
+    set->members[set->count].object = object;
+    set->members[set->count].semaphore = semaphore;
+    set->count++;
+    *member_set = set;
+    return true;
+}
 
-    printf("Starting scheduler\n");
+// Only the consumer of the queue may select on the set
+bool queue_set_add_queue(queue_set_t *set, queue_t *queue) {
+    return queue_set_add(set, queue, &queue->set, false);
+}
 
-    // Main loop
+bool queue_set_add_semaphore(queue_set_t *set, semaphore_t *sem) {
+    return queue_set_add(set, sem, &sem->set, true);
+}
+
+// A member with an item or a count to take, or NULL
+static void *queue_set_ready(queue_set_t *set) {
+    for (int i = 0; i < set->count; i++) {
+        int m = (set->next + i) % set->count;
+        void *object = set->members[m].object;
+        if (set->members[m].semaphore ? ((semaphore_t *)object)->count > 0 : queue_count(object) > 0) {
+            set->next = (m + 1) % set->count;
+            return object;
+        }
+    }
+    return NULL;
+}
+
+// Block until a member queue has an item or a member semaphore a count, for up to timeout_ms, and
+// return that member (NULL on timeout). It is not taken: follow with queue_receive(..., 0),
+// queue_pop() or semaphore_try_wait(), which can still fail if another task took the semaphore first.
+// Outside a stackful task this polls. Not from an ISR.
+void *queue_set_select(queue_set_t *set, uint32_t timeout_ms) {
+    uint64_t wake_us = queue_wake_time(timeout_ms);
+    void *member;
+
+    while ((member = queue_set_ready(set)) == NULL) {
+        if (wake_us != WAIT_FOREVER_US && esp_timer_get_time() >= wake_us) return NULL;
+
+        port_irq_state_t irq = port_irq_disable();
+        int self = task_current();
+        if (self == -1) {
+            port_irq_restore(irq);
+            continue;
+        }
+        spin_lock(&set->lock);
+        set->waiting = true;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST); // Pairs with the one in waiting_flag_wake()
+        if (queue_set_ready(set) == NULL) {
+            task_block(&set->waiters, &set->lock, irq, wake_us);
+            irq = port_irq_disable();
+            spin_lock(&set->lock);
+            wait_list_remove(&set->waiters, self); // Still listed if the wait timed out
+        }
+        set->waiting = set->waiters.head != 0; // Other tasks may still select on it
+        spin_unlock(&set->lock);
+        port_irq_restore(irq);
+    }
+    return member;
+}
+
+// Event group functions
+
+// Whether `bits` satisfy a wait for any or all of `mask`
+static inline bool IRAM_ATTR event_bits_match(uint32_t bits, uint32_t mask, bool all) {
+    return all ? (bits & mask) == mask : (bits & mask) != 0;
+}
+
+// Satisfy a wait without blocking if the bits allow, clearing them atomically if asked. *bits gets
+// the group's bits before any clearing.
+static bool event_group_take(event_group_t *group, uint32_t mask, bool all, bool clear, uint32_t *bits) {
+    uint32_t value = __atomic_load_n(&group->bits, __ATOMIC_ACQUIRE);
+
+    do {
+        if (!event_bits_match(value, mask, all)) {
+            *bits = value;
+            return false;
+        }
+    } while (clear && !__atomic_compare_exchange_n(&group->bits, &value, value & ~mask, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    *bits = value;
+    return true;
+}
+
+// After bits were set: wake every waiter they satisfy in one pass over the wait list, then clear the
+// bits of those that asked. Returns true if it woke a task.
+static bool IRAM_ATTR event_group_wake(event_group_t *group) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Pairs with the one in event_group_wait()
+    if (!group->waiting) return false;
+
+    port_irq_state_t irq = port_irq_disable();
+    spin_lock(&group->lock);
+    uint32_t value = group->bits;
+    uint32_t clear = 0;
+    bool woken = false;
+    int *link = &group->waiters.head;
+    while (*link != 0) {
+        int index = *link - 1;
+        task_t *task = &task_list[index];
+        if (!event_bits_match(value, task->event_mask, task->event_all)) {
+            link = &task->next_waiter;
+            continue;
+        }
+        *link = task->next_waiter;
+        task->next_waiter = 0;
+        if (task->event_clear) {
+            clear |= task->event_mask;
+        }
+        task->event_bits = value;
+        task->event_mask = 0; // Satisfied, even if it timed out meanwhile
+        woken |= task_wake(index);
+    }
+    if (clear != 0) {
+        __atomic_fetch_and(&group->bits, ~clear, __ATOMIC_RELEASE);
+    }
+    group->waiting = group->waiters.head != 0;
+    spin_unlock(&group->lock);
+    port_irq_restore(irq);
+    return woken;
+}
+
+// Activate the tasks bound to any of the bits just set
+static bool IRAM_ATTR event_group_activate(event_group_t *group, uint32_t bits) {
+    bool woken = false;
+
+    for (int link = group->activates; link != 0; link = task_list[link - 1].next_activated) {
+        if ((task_list[link - 1].activation_mask & bits) != 0) {
+            woken |= task_activate(link - 1);
+        }
+    }
+    return woken;
+}
+
+// Set bits, wake the tasks that now have what they wait for and activate the tasks bound to them.
+// Returns the bits before setting.
+uint32_t event_group_set(event_group_t *group, uint32_t bits) {
+    uint32_t previous = __atomic_fetch_or(&group->bits, bits, __ATOMIC_RELEASE);
+    bool woken = event_group_wake(group);
+
+    woken |= event_group_activate(group, bits);
+    if (woken) {
+        task_yield_if_preempted();
+    }
+    return previous;
+}
+
+// event_group_set() for interrupt handlers. *woken is set if it woke a task; end the handler with
+// scheduler_yield_from_isr() then.
+uint32_t IRAM_ATTR event_group_set_from_isr(event_group_t *group, uint32_t bits, bool *woken) {
+    uint32_t previous = __atomic_fetch_or(&group->bits, bits, __ATOMIC_RELEASE);
+
+    *woken = event_group_wake(group);
+    *woken |= event_group_activate(group, bits);
+    return previous;
+}
+
+// Clear bits, from a task or an ISR. Returns the bits before clearing.
+uint32_t IRAM_ATTR event_group_clear(event_group_t *group, uint32_t bits) {
+    return __atomic_fetch_and(&group->bits, ~bits, __ATOMIC_RELEASE);
+}
+
+uint32_t IRAM_ATTR event_group_get(event_group_t *group) {
+    return __atomic_load_n(&group->bits, __ATOMIC_ACQUIRE);
+}
+
+// Block until any (all = false) or all of the bits in mask are set, for up to timeout_ms
+// (QUEUE_WAIT_FOREVER, or 0 to not wait), then clear them if clear_on_exit. Returns the group's bits
+// when the wait was satisfied, before clearing, or its bits at the timeout: test them against mask.
+// Outside a stackful task this polls. Not from an ISR.
+uint32_t event_group_wait(event_group_t *group, uint32_t mask, bool all, bool clear_on_exit, uint32_t timeout_ms) {
+    uint64_t wake_us = queue_wake_time(timeout_ms);
+    uint32_t bits;
+
+    while (!event_group_take(group, mask, all, clear_on_exit, &bits)) {
+        if (wake_us != WAIT_FOREVER_US && esp_timer_get_time() >= wake_us) return bits;
+
+        port_irq_state_t irq = port_irq_disable();
+        int self = task_current();
+        if (self == -1) {
+            port_irq_restore(irq);
+            continue;
+        }
+        task_t *task = &task_list[self];
+        spin_lock(&group->lock);
+        group->waiting = true;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (event_group_take(group, mask, all, clear_on_exit, &bits)) {
+            group->waiting = group->waiters.head != 0;
+            spin_unlock(&group->lock);
+            port_irq_restore(irq);
+            break;
+        }
+        task->event_mask = mask;
+        task->event_all = all;
+        task->event_clear = clear_on_exit;
+        task_block(&group->waiters, &group->lock, irq, wake_us);
+
+        irq = port_irq_disable();
+        spin_lock(&group->lock);
+        bool satisfied = task->event_mask == 0;
+        if (satisfied) {
+            bits = task->event_bits;
+        } else { // Timed out
+            wait_list_remove(&group->waiters, self);
+            task->event_mask = 0;
+            bits = group->bits;
+        }
+        group->waiting = group->waiters.head != 0;
+        spin_unlock(&group->lock);
+        port_irq_restore(irq);
+        if (satisfied || (wake_us != WAIT_FOREVER_US && esp_timer_get_time() >= wake_us)) break;
+    }
+    return bits;
+}
+
+// Software timer functions. Callbacks run one at a time in the timer service task, without its lock
+// held, so they may start, stop or reset any timer, their own included. Keep them short: while one
+// runs, every other timer waits. Not from an ISR.
+
+// Set up a stopped timer. False if a periodic timer has no period.
+bool soft_timer_create(soft_timer_t *timer, uint32_t period_ms, bool periodic, soft_timer_callback_t callback, void *arg) {
+    if (periodic && period_ms == 0) return false;
+    timer->entry.slot = -1;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->period_ms = period_ms;
+    timer->periodic = periodic;
+    timer->expiries = 0;
+    return true;
+}
+
+// Take a timer off the service's wheel if it is running and `restart` is set (or it is stopped), then
+// put it back to expire period_ms from now if `run` is set. Returns whether it was running.
+static bool soft_timer_set(soft_timer_t *timer, bool restart, bool run) {
+    bool woken = false;
+    port_irq_state_t irq = port_irq_disable();
+    spin_lock(&timer_service.lock);
+    bool running = timer->entry.slot != -1;
+
+    if (!running || restart) {
+        if (running) {
+            release_wheel_remove(&timer_service.wheel, &timer->entry);
+        }
+        if (run) {
+            timer->entry.time = esp_timer_get_time() + (uint64_t)timer->period_ms * 1000;
+            release_wheel_push(&timer_service.wheel, &timer->entry);
+            if (timer->entry.time < timer_service.wake_us) { // Sooner than the service would wake
+                int index = wait_list_pop(&timer_service.waiters);
+                woken = index != -1 && task_wake(index);
+            }
+        }
+    }
+    spin_unlock(&timer_service.lock);
+    port_irq_restore(irq);
+    if (woken) {
+        task_yield_if_preempted();
+    }
+    return running;
+}
+
+// Start a stopped timer: it expires period_ms from now. False, with no change, if it is running.
+bool soft_timer_start(soft_timer_t *timer) {
+    return !soft_timer_set(timer, false, true);
+}
+
+// Stop a timer before its next expiry. False if it was not running.
+bool soft_timer_stop(soft_timer_t *timer) {
+    return soft_timer_set(timer, true, false);
+}
+
+// Restart a timer from now, whether it was running or not
+void soft_timer_reset(soft_timer_t *timer) {
+    soft_timer_set(timer, true, true);
+}
+
+// The timer service's job. A periodic timer is re-armed before its callback runs, a whole number
+// of periods after its last expiry, so it does not drift; expiries the service was too late for are
+// skipped, like OVERRUN_SKIP.
+static void timer_service_task(void *param) {
+    port_irq_state_t irq = port_irq_disable();
+    int self = task_current();
+    spin_lock(&timer_service.lock);
+
+    while (1) {
+        uint64_t now = esp_timer_get_time();
+        wheel_entry_t *entry = release_wheel_expire(&timer_service.wheel, now);
+        if (entry == NULL) {
+            timer_service.wake_us = release_wheel_next_time(&timer_service.wheel);
+            task_block(&timer_service.waiters, &timer_service.lock, irq, timer_service.wake_us);
+            irq = port_irq_disable();
+            spin_lock(&timer_service.lock);
+            wait_list_remove(&timer_service.waiters, self); // Still listed if the sleep timed out
+            continue;
+        }
+
+        soft_timer_t *timer = (soft_timer_t *)((uint8_t *)entry - offsetof(soft_timer_t, entry));
+        if (timer->periodic) {
+            uint64_t period = (uint64_t)timer->period_ms * 1000;
+            entry->time += period;
+            if (entry->time <= now) {
+                entry->time += (now - entry->time) / period * period + period;
+            }
+            release_wheel_push(&timer_service.wheel, entry);
+        }
+        timer->expiries++;
+        soft_timer_callback_t callback = timer->callback;
+        void *arg = timer->arg;
+        spin_unlock(&timer_service.lock);
+        port_irq_restore(irq);
+        callback(timer, arg);
+        irq = port_irq_disable();
+        spin_lock(&timer_service.lock);
+    }
+}
+
+// Mutex functions. The slow paths walk chains of owners and the mutexes they are blocked on, so
+// they all share one lock.
+static volatile bool mutex_chain_lock = false;
+
+static inline int mutex_owner_value(int self) {
+    return self != -1 ? self + 1 : MUTEX_OWNER_NONTASK;
+}
+
+// Owning task of an owner value, or -1
+static inline int mutex_owner_task(int owner) {
+    int index = (owner & ~MUTEX_CONTENDED) - 1;
+    return index >= 0 && index < task_count ? index : -1;
+}
+
+// With interrupts disabled: take the mutex if it is free
+static bool mutex_acquire(mutex_t *mutex, int self) {
+    int expected = 0;
+
+    if (!__atomic_compare_exchange_n(&mutex->owner, &expected, mutex_owner_value(self), false, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED)) {
+        return false;
+    }
+    mutex->stats.acquisitions++;
+    mutex->locked_at = esp_timer_get_time();
+    if (self != -1) {
+        mutex->next_held = task_list[self].held;
+        task_list[self].held = mutex;
+    }
+    return true;
+}
+
+static void mutex_held_remove(task_t *task, mutex_t *mutex) {
+    mutex_t **link = &task->held;
+
+    while (*link != NULL && *link != mutex) {
+        link = &(*link)->next_held;
+    }
+    if (*link != NULL) {
+        *link = mutex->next_held;
+    }
+}
+
+// The priority a task runs at: its own, that of the highest task blocked on a mutex it holds, or the
+// ceiling of a mutex it holds, whichever is highest
+static int mutex_inherited_priority(task_t *task) {
+    int priority = task->base_priority;
+
+    for (mutex_t *held = task->held; held != NULL; held = held->next_held) {
+        if (held->waiters.head != 0 && task_list[held->waiters.head - 1].priority < priority) {
+            priority = task_list[held->waiters.head - 1].priority;
+        }
+        if (held->ceiling != 0 && held->ceiling - 1 < priority) {
+            priority = held->ceiling - 1;
+        }
+    }
+    return priority;
+}
+
+// With interrupts disabled and mutex_chain_lock held: run a new owner of a ceiling mutex at the ceiling
+static void mutex_enter_ceiling(mutex_t *mutex, int owner) {
+    if (mutex->ceiling != 0 && owner != -1 && mutex->ceiling - 1 < task_list[owner].priority) {
+        task_set_priority(owner, mutex->ceiling - 1);
+    }
+}
+
+// With interrupts disabled: mutex_acquire(), then raise the caller to the mutex's ceiling
+static bool mutex_take(mutex_t *mutex, int self) {
+    if (!mutex_acquire(mutex, self)) return false;
+    if (mutex->ceiling != 0 && self != -1) {
+        spin_lock(&mutex_chain_lock);
+        mutex_enter_ceiling(mutex, self);
+        spin_unlock(&mutex_chain_lock);
+    }
+    return true;
+}
+
+// Turn an unlocked mutex into an immediate priority ceiling mutex. The ceiling must be at least the
+// priority of every task that locks it (a lower value or equal). SCHEDULER_EDF dispatches by deadline
+// and ignores the ceiling: the mutex still excludes, but a locker may find it taken and block, for
+// longer than one critical section.
+void mutex_init_ceiling(mutex_t *mutex, int ceiling) {
+    if (ceiling < 0 || ceiling >= MAX_PRIORITIES) {
+        ESP_LOGW("Mutex", "Ceiling %d out of range", ceiling);
+        return;
+    }
+    mutex->ceiling = ceiling + 1;
+}
+
+// While the owner runs on another core and nobody is blocked yet, check the mutex up to
+// mutex_spin_limit times before blocking: a short critical section there ends sooner than a block
+// and wake would take. Returns whether the mutex was taken.
+static bool mutex_spin(mutex_t *mutex, int self) {
+    uint32_t spins = 0;
+    bool taken = false;
+
+    while (spins < mutex_spin_limit) {
+        int owner = __atomic_load_n(&mutex->owner, __ATOMIC_RELAXED);
+        if (owner == 0) {
+            port_irq_state_t irq = port_irq_disable();
+            taken = mutex_take(mutex, self);
+            port_irq_restore(irq);
+            if (taken) break;
+        } else if ((owner & MUTEX_CONTENDED) || !task_running_elsewhere(mutex_owner_task(owner))) {
+            break; // Queue behind the waiters, or the owner will not release it soon
+        }
+        spins++;
+    }
+    if (spins > 0) {
+        __atomic_fetch_add(&mutex->stats.spins, spins, __ATOMIC_RELAXED);
+    }
+    if (taken) {
+        mutex->stats.contended++;
+    }
+    return taken;
+}
+
+// Lock the mutex. A stackful task spins briefly while the owner runs on another core, then blocks
+// until the mutex is handed over; a blocked task lends its priority to the owner, and on to the
+// owner of any mutex that one is blocked on in turn. Outside a stackful task this spins.
+void mutex_lock(mutex_t *mutex) {
+    port_irq_state_t irq = port_irq_disable();
+    int self = task_current();
+
+    if (mutex_take(mutex, self)) {
+        port_irq_restore(irq);
+        return;
+    }
+    port_irq_restore(irq);
+    if (self == -1) {
+        uint32_t spins = 0;
+        while (!mutex_try_lock(mutex)) {
+            spins++;
+        }
+        __atomic_fetch_add(&mutex->stats.spins, spins, __ATOMIC_RELAXED);
+        mutex->stats.contended++;
+        return;
+    }
+    if (mutex_spin(mutex, self)) return;
+
+    irq = port_irq_disable();
+    spin_lock(&mutex_chain_lock);
+    int owner = mutex->owner;
+    while (!(owner & MUTEX_CONTENDED)) { // Make the owner's unlock take the slow path
+        if (owner == 0) {
+            if (mutex_acquire(mutex, self)) { // Released meanwhile
+                mutex_enter_ceiling(mutex, self);
+                mutex->stats.contended++;
+                spin_unlock(&mutex_chain_lock);
+                port_irq_restore(irq);
+                return;
+            }
+            owner = mutex->owner;
+        } else if (__atomic_compare_exchange_n(&mutex->owner, &owner, owner | MUTEX_CONTENDED, false,
+                                               __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    task_t *task = &task_list[self];
+    task->blocked_on = mutex;
+    for (mutex_t *m = mutex; m != NULL;) {
+        int holder = mutex_owner_task(m->owner);
+        if (holder == -1 || task_list[holder].priority <= task->priority) break;
+        task_set_priority(holder, task->priority);
+        m = task_list[holder].blocked_on;
+    }
+    task_block(&mutex->waiters, &mutex_chain_lock, irq, WAIT_FOREVER_US); // mutex_unlock() hands ownership over
+    mutex->stats.acquisitions++;
+    mutex->stats.contended++;
+    mutex->locked_at = esp_timer_get_time();
+}
+
+bool mutex_try_lock(mutex_t *mutex) {
+    port_irq_state_t irq = port_irq_disable();
+    bool locked = mutex_take(mutex, task_current());
+    port_irq_restore(irq);
+    return locked;
+}
+
+// Unlock the mutex, handing it straight to the highest-priority waiter, and drop any priority the
+// caller inherited through it
+void mutex_unlock(mutex_t *mutex) {
+    port_irq_state_t irq = port_irq_disable();
+    int self = task_current();
+    int expected = mutex_owner_value(self);
+    uint32_t hold_us = (uint32_t)(esp_timer_get_time() - mutex->locked_at);
+
+    if (hold_us > mutex->stats.max_hold_us) {
+        mutex->stats.max_hold_us = hold_us;
+    }
+    if (self != -1) {
+        mutex_held_remove(&task_list[self], mutex);
+    }
+    bool contended = !__atomic_compare_exchange_n(&mutex->owner, &expected, 0, false, __ATOMIC_RELEASE,
+                                                  __ATOMIC_RELAXED);
+    if (!contended && (mutex->ceiling == 0 || self == -1)) {
+        port_irq_restore(irq); // Uncontended, so nothing was inherited through it
+        return;
+    }
+
+    spin_lock(&mutex_chain_lock);
+    int next;
+    int owner = 0;
+    while (contended && (next = wait_list_pop(&mutex->waiters)) != -1) {
+        task_t *task = &task_list[next];
+        owner = (next + 1) | (mutex->waiters.head != 0 ? MUTEX_CONTENDED : 0);
+        __atomic_store_n(&mutex->owner, owner, __ATOMIC_RELEASE);
+        task->blocked_on = NULL;
+        mutex->next_held = task->held;
+        task->held = mutex;
+        mutex_enter_ceiling(mutex, next);
+        if (task_wake(next)) break;
+        task->held = mutex->next_held; // Removed while blocked
+        owner = 0;
+    }
+    if (contended && owner == 0) {
+        __atomic_store_n(&mutex->owner, 0, __ATOMIC_RELEASE);
+    }
+    if (self != -1) {
+        task_set_priority(self, mutex_inherited_priority(&task_list[self]));
+    }
+    spin_unlock(&mutex_chain_lock);
+    port_irq_restore(irq);
+    task_yield_if_preempted();
+}
+
+// Checks of a mutex held on another core before mutex_lock() blocks (0 = block at once)
+void mutex_set_spin_limit(uint32_t checks) {
+    mutex_spin_limit = checks;
+}
+
+mutex_stats_t mutex_get_stats(const mutex_t *mutex) {
+    mutex_stats_t stats = mutex->stats;
+    stats.spins = __atomic_load_n(&mutex->stats.spins, __ATOMIC_RELAXED);
+    return stats;
+}
+
+// Ready list functions
+void IRAM_ATTR ready_list_push(core_t *core, int index) {
+    task_t *task = &task_list[index];
+    ready_list_t *list = &core->ready_lists[task->priority];
+
+    task->prev_ready = list->tail;
+    task->next_ready = -1;
+    if (list->tail != -1) {
+        task_list[list->tail].next_ready = index;
+    } else {
+        list->head = index;
+        core->ready_bitmap |= 1u << (31 - task->priority);
+    }
+    list->tail = index;
+}
+
+void IRAM_ATTR ready_list_remove(core_t *core, int index) {
+    task_t *task = &task_list[index];
+    ready_list_t *list = &core->ready_lists[task->priority];
+
+    if (task->prev_ready != -1) {
+        task_list[task->prev_ready].next_ready = task->next_ready;
+    } else {
+        list->head = task->next_ready;
+    }
+    if (task->next_ready != -1) {
+        task_list[task->next_ready].prev_ready = task->prev_ready;
+    } else {
+        list->tail = task->prev_ready;
+    }
+    if (list->head == -1) {
+        core->ready_bitmap &= ~(1u << (31 - task->priority));
+    }
+    task->prev_ready = -1;
+    task->next_ready = -1;
+}
+
+// Index of the oldest task at the highest ready priority, or -1 if none is ready
+int IRAM_ATTR ready_list_highest(core_t *core) {
+    if (core->ready_bitmap == 0) return -1;
+    return core->ready_lists[__builtin_clz(core->ready_bitmap)].head; // NSAU on Xtensa
+}
+
+// Task heap functions
+static inline uint64_t IRAM_ATTR task_heap_key(task_heap_t *heap, int index) {
+    return *(uint64_t *)((uint8_t *)&task_list[index] + heap->key_offset);
+}
+
+static void IRAM_ATTR task_heap_place(task_heap_t *heap, int pos, int index) {
+    heap->items[pos] = index;
+    task_list[index].heap_index = pos;
+}
+
+static void IRAM_ATTR task_heap_sift_up(task_heap_t *heap, int pos) {
+    int index = heap->items[pos];
+    uint64_t key = task_heap_key(heap, index);
+
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (task_heap_key(heap, heap->items[parent]) <= key) break;
+        task_heap_place(heap, pos, heap->items[parent]);
+        pos = parent;
+    }
+    task_heap_place(heap, pos, index);
+}
+
+static void IRAM_ATTR task_heap_sift_down(task_heap_t *heap, int pos) {
+    int index = heap->items[pos];
+    uint64_t key = task_heap_key(heap, index);
+
+    while (1) {
+        int child = 2 * pos + 1;
+        if (child >= heap->size) break;
+        if (child + 1 < heap->size &&
+            task_heap_key(heap, heap->items[child + 1]) < task_heap_key(heap, heap->items[child])) {
+            child++;
+        }
+        if (key <= task_heap_key(heap, heap->items[child])) break;
+        task_heap_place(heap, pos, heap->items[child]);
+        pos = child;
+    }
+    task_heap_place(heap, pos, index);
+}
+
+void IRAM_ATTR task_heap_push(task_heap_t *heap, int index) {
+    task_heap_place(heap, heap->size, index);
+    heap->size++;
+    task_heap_sift_up(heap, heap->size - 1);
+}
+
+// Index of the task with the smallest key, or -1 if the heap is empty
+int IRAM_ATTR task_heap_top(task_heap_t *heap) {
+    return heap->size > 0 ? heap->items[0] : -1;
+}
+
+void IRAM_ATTR task_heap_remove(task_heap_t *heap, int index) {
+    int pos = task_list[index].heap_index;
+    int last = heap->items[--heap->size];
+
+    task_list[index].heap_index = -1;
+    if (last == index) return;
+    task_heap_place(heap, pos, last);
+    if (pos > 0 && task_heap_key(heap, last) < task_heap_key(heap, heap->items[(pos - 1) / 2])) {
+        task_heap_sift_up(heap, pos);
+    } else {
+        task_heap_sift_down(heap, pos);
+    }
+}
+
+// Release heap functions (core locked)
+void release_heap_init(release_heap_t *heap) {
+    heap->size = 0;
+}
+
+static void IRAM_ATTR release_heap_place(release_heap_t *heap, int pos, wheel_entry_t *entry) {
+    heap->items[pos] = entry;
+    entry->slot = pos;
+}
+
+static void IRAM_ATTR release_heap_sift_up(release_heap_t *heap, int pos) {
+    wheel_entry_t *entry = heap->items[pos];
+
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (heap->items[parent]->time <= entry->time) break;
+        release_heap_place(heap, pos, heap->items[parent]);
+        pos = parent;
+    }
+    release_heap_place(heap, pos, entry);
+}
+
+static void IRAM_ATTR release_heap_sift_down(release_heap_t *heap, int pos) {
+    wheel_entry_t *entry = heap->items[pos];
+
+    while (1) {
+        int child = 2 * pos + 1;
+        if (child >= heap->size) break;
+        if (child + 1 < heap->size && heap->items[child + 1]->time < heap->items[child]->time) {
+            child++;
+        }
+        if (entry->time <= heap->items[child]->time) break;
+        release_heap_place(heap, pos, heap->items[child]);
+        pos = child;
+    }
+    release_heap_place(heap, pos, entry);
+}
+
+void IRAM_ATTR release_heap_push(release_heap_t *heap, wheel_entry_t *entry) {
+    release_heap_place(heap, heap->size, entry);
+    heap->size++;
+    release_heap_sift_up(heap, heap->size - 1);
+}
+
+void IRAM_ATTR release_heap_remove(release_heap_t *heap, wheel_entry_t *entry) {
+    int pos = entry->slot;
+    wheel_entry_t *last = heap->items[--heap->size];
+
+    entry->slot = -1;
+    if (last == entry) return;
+    release_heap_place(heap, pos, last);
+    if (pos > 0 && last->time < heap->items[(pos - 1) / 2]->time) {
+        release_heap_sift_up(heap, pos);
+    } else {
+        release_heap_sift_down(heap, pos);
+    }
+}
+
+// Take off the earliest entry if its time has passed, or return NULL
+wheel_entry_t *IRAM_ATTR release_heap_expire(release_heap_t *heap, uint64_t now) {
+    if (heap->size == 0 || heap->items[0]->time > now) return NULL;
+
+    wheel_entry_t *entry = heap->items[0];
+    release_heap_remove(heap, entry);
+    return entry;
+}
+
+// Earliest time on the heap, or UINT64_MAX
+uint64_t IRAM_ATTR release_heap_next_time(release_heap_t *heap) {
+    return heap->size > 0 ? heap->items[0]->time : UINT64_MAX;
+}
+
+// Release wheel functions (core locked, or the timer service's lock for its wheel)
+void release_wheel_init(release_wheel_t *wheel) {
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+            wheel->slots[level][slot] = NULL;
+        }
+        wheel->occupied[level] = 0;
+    }
+    wheel->tick = 0;
+    wheel->size = 0;
+}
+
+// Put an entry into the slot for its time: the lowest level whose turn reaches that far from the
+// current tick. Times already due go to the current slot, and times beyond the wheel's span to the
+// farthest slot, from which they are cascaded back in later.
+static void IRAM_ATTR release_wheel_link(release_wheel_t *wheel, wheel_entry_t *entry) {
+    uint64_t tick = entry->time >> WHEEL_TICK_SHIFT;
+    uint64_t span = 1ULL << (WHEEL_SLOT_BITS * WHEEL_LEVELS);
+    int level = 0;
+
+    if (tick < wheel->tick) {
+        tick = wheel->tick;
+    } else if (tick - wheel->tick >= span) {
+        tick = wheel->tick + span - 1;
+    }
+    while (tick - wheel->tick >= 1ULL << (WHEEL_SLOT_BITS * (level + 1))) {
+        level++;
+    }
+    int slot = (tick >> (WHEEL_SLOT_BITS * level)) & (WHEEL_SLOTS - 1);
+    wheel_entry_t **head = &wheel->slots[level][slot];
+    entry->slot = level * WHEEL_SLOTS + slot;
+    entry->prev = NULL;
+    entry->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = entry;
+    }
+    *head = entry;
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+void IRAM_ATTR release_wheel_push(release_wheel_t *wheel, wheel_entry_t *entry) {
+    release_wheel_link(wheel, entry);
+    wheel->size++;
+}
+
+void IRAM_ATTR release_wheel_remove(release_wheel_t *wheel, wheel_entry_t *entry) {
+    int level = entry->slot / WHEEL_SLOTS;
+    int slot = entry->slot % WHEEL_SLOTS;
+
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        wheel->slots[level][slot] = entry->next;
+        if (entry->next == NULL) {
+            wheel->occupied[level] &= ~(1ULL << slot);
+        }
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    }
+    entry->slot = -1;
+    wheel->size--;
+}
+
+// First tick at which `level` has an occupied slot: the slot's own tick at level 0 (from the current
+// one on), the start of its turn above (after the current slot, which is a whole turn away). UINT64_MAX if empty.
+static uint64_t IRAM_ATTR release_wheel_slot_tick(release_wheel_t *wheel, int level) {
+    uint64_t occupied = wheel->occupied[level];
+    int shift = WHEEL_SLOT_BITS * level;
+    uint64_t position = wheel->tick >> shift;
+    int first = level == 0 ? 0 : 1;
+    int rotate = (position + first) & (WHEEL_SLOTS - 1);
+
+    if (occupied == 0) return UINT64_MAX;
+    if (rotate != 0) {
+        occupied = occupied >> rotate | occupied << (WHEEL_SLOTS - rotate);
+    }
+    return (position + first + __builtin_ctzll(occupied)) << shift;
+}
+
+// Earliest tick at which the wheel has work: a level-0 slot to release or a higher slot to cascade
+static uint64_t IRAM_ATTR release_wheel_next_tick(release_wheel_t *wheel) {
+    uint64_t next = UINT64_MAX;
+
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        uint64_t tick = release_wheel_slot_tick(wheel, level);
+        if (tick < next) {
+            next = tick;
+        }
+    }
+    return next;
+}
+
+// Earliest time on the wheel, or UINT64_MAX. Exact for level 0; a higher level contributes the
+// start of its next cascade, after which the lower levels give the exact time.
+uint64_t IRAM_ATTR release_wheel_next_time(release_wheel_t *wheel) {
+    uint64_t next = UINT64_MAX;
+    uint64_t tick = release_wheel_slot_tick(wheel, 0);
+
+    if (tick != UINT64_MAX) {
+        for (wheel_entry_t *entry = wheel->slots[0][tick & (WHEEL_SLOTS - 1)]; entry != NULL; entry = entry->next) {
+            if (entry->time < next) {
+                next = entry->time;
+            }
+        }
+    }
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        tick = release_wheel_slot_tick(wheel, level);
+        if (tick != UINT64_MAX && tick << WHEEL_TICK_SHIFT < next) {
+            next = tick << WHEEL_TICK_SHIFT;
+        }
+    }
+    return next;
+}
+
+// On reaching a tick that starts a turn of level L-1: move the entries of level L's current slot down
+static void IRAM_ATTR release_wheel_cascade(release_wheel_t *wheel) {
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        if ((wheel->tick & ((1ULL << (WHEEL_SLOT_BITS * level)) - 1)) != 0) break;
+
+        int slot = (wheel->tick >> (WHEEL_SLOT_BITS * level)) & (WHEEL_SLOTS - 1);
+        wheel_entry_t *entry = wheel->slots[level][slot];
+        wheel->slots[level][slot] = NULL;
+        wheel->occupied[level] &= ~(1ULL << slot);
+        while (entry != NULL) {
+            wheel_entry_t *next = entry->next;
+            release_wheel_link(wheel, entry);
+            entry = next;
+        }
+    }
+}
+
+// Take off one entry whose time has passed, or return NULL once there are none. The wheel jumps
+// from one tick with work to the next rather than stepping through every tick.
+wheel_entry_t *IRAM_ATTR release_wheel_expire(release_wheel_t *wheel, uint64_t now) {
+    uint64_t target = now >> WHEEL_TICK_SHIFT;
+
+    while (1) {
+        for (wheel_entry_t *entry = wheel->slots[0][wheel->tick & (WHEEL_SLOTS - 1)]; entry != NULL; entry = entry->next) {
+            if (entry->time <= now) {
+                release_wheel_remove(wheel, entry);
+                return entry;
+            }
+        }
+        if (wheel->tick >= target) return NULL;
+
+        uint64_t tick = release_wheel_next_tick(wheel); // Later than the slot just emptied
+        wheel->tick = tick < target ? tick : target;
+        release_wheel_cascade(wheel);
+    }
+}
+
+// Work-stealing deque functions (Chase-Lev, fixed size)
+bool IRAM_ATTR steal_deque_push(steal_deque_t *deque, int index) {
+    int32_t bottom = deque->bottom;
+    int32_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+
+    if (bottom - top >= STEAL_DEQUE_SIZE) return false;
+    deque->items[bottom & (STEAL_DEQUE_SIZE - 1)] = index;
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Owner side: take the newest entry, racing thieves only for the last one
+bool IRAM_ATTR steal_deque_pop(steal_deque_t *deque, int *index) {
+    int32_t bottom = deque->bottom - 1;
+
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int32_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    *index = deque->items[bottom & (STEAL_DEQUE_SIZE - 1)];
+    if (top == bottom) {
+        bool won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return won;
+    }
+    return true;
+}
+
+// Thief side: take the oldest entry, or -1 if the deque is empty
+int IRAM_ATTR steal_deque_steal(steal_deque_t *deque) {
+    while (1) {
+        int32_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int32_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+        if (top >= bottom) return -1;
+        int index = deque->items[top & (STEAL_DEQUE_SIZE - 1)];
+        if (__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return index;
+        }
+    }
+}
+
+// Whether another core may take this task's ready job
+static bool IRAM_ATTR task_stealable(const task_t *task) {
+    return task->migration == MIGRATE_JOBS || (task->migration == MIGRATE_UNPINNED && task->affinity == CORE_ANY);
+}
+
+// Whether a deque entry still names a job this core could hand to a thief
+static bool IRAM_ATTR steal_hint_live(core_t *core, int index) {
+    const task_t *task = &task_list[index];
+    return task->state == TASK_READY && task->core == core - cores && task_stealable(task);
+}
+
+// Owner side, core locked: drop the newest entries down to the first live one. A dispatched job is
+// usually the newest, so most hints go as soon as they are stale.
+static void IRAM_ATTR steal_deque_trim(core_t *core, int removed) {
+    int index;
+
+    while (steal_deque_pop(&core->steal_deque, &index)) {
+        if (index != removed && steal_hint_live(core, index)) {
+            steal_deque_push(&core->steal_deque, index); // Still on offer
+            return;
+        }
+    }
+}
+
+// Owner side, core locked, deque full: keep one entry per job still on offer, in their order, and
+// none for task `skip`, which is about to be pushed again
+static void IRAM_ATTR steal_deque_compact(core_t *core, int skip) {
+    int live[STEAL_DEQUE_SIZE];
+    bool kept[MAX_TASKS] = { false };
+    int count = 0;
+    int index;
+
+    kept[skip] = true;
+    while (steal_deque_pop(&core->steal_deque, &index)) { // Newest first
+        if (!kept[index] && steal_hint_live(core, index)) {
+            kept[index] = true;
+            live[count++] = index;
+        }
+    }
+    while (count > 0) {
+        steal_deque_push(&core->steal_deque, live[--count]);
+    }
+}
+
+// Ready queue functions: per-priority lists, or the deadline heap under EDF
+void IRAM_ATTR ready_push(core_t *core, int index) {
+    if (scheduler_type == SCHEDULER_EDF) {
+        task_heap_push(&core->deadline_heap, index);
+    } else {
+        ready_list_push(core, index);
+    }
+    if (work_stealing && task_stealable(&task_list[index]) && !steal_deque_push(&core->steal_deque, index)) {
+        steal_deque_compact(core, index); // Full of hints for jobs dispatched below a live one
+        steal_deque_push(&core->steal_deque, index);
+    }
+}
+
+void IRAM_ATTR ready_remove(core_t *core, int index) {
+    if (scheduler_type == SCHEDULER_EDF) {
+        task_heap_remove(&core->deadline_heap, index);
+    } else {
+        ready_list_remove(core, index);
+    }
+    if (core->ready_bitmap == 0 && core->deadline_heap.size == 0) {
+        int stale;
+        while (steal_deque_pop(&core->steal_deque, &stale)); // Nothing left to offer
+    } else if (work_stealing) {
+        steal_deque_trim(core, index);
+    }
+}
+
+// The ready task the policy would run next: earliest deadline under EDF, else highest priority
+int IRAM_ATTR ready_highest(core_t *core) {
+    if (scheduler_type == SCHEDULER_EDF) {
+        return task_heap_top(&core->deadline_heap);
+    }
+    return ready_list_highest(core);
+}
+
+// Whether the timer interrupt preempts running tasks
+static inline bool IRAM_ATTR scheduler_preemptive(void) {
+    return scheduler_type == SCHEDULER_PREEMPTIVE || scheduler_type == SCHEDULER_EDF;
+}
+
+// Whether ready task `candidate` should preempt running task `running`
+static bool IRAM_ATTR ready_preempts(int candidate, int running) {
+    if (scheduler_type == SCHEDULER_EDF) {
+        return task_list[candidate].deadline < task_list[running].deadline;
+    }
+    return task_list[candidate].priority < task_list[running].priority;
+}
+
+// Core locking: a spinlock per core, taken with interrupts already disabled. Two cores are always
+// locked in index order so that cores locking each other's queues cannot deadlock.
+static inline core_t *IRAM_ATTR this_core(void) {
+    return &cores[port_core_id()];
+}
+
+static void IRAM_ATTR core_spin_lock_pair(core_t *a, core_t *b) {
+    if (b < a) {
+        core_t *t = a;
+        a = b;
+        b = t;
+    }
+    while (__atomic_test_and_set(&a->lock, __ATOMIC_ACQUIRE));
+    if (b != a) {
+        while (__atomic_test_and_set(&b->lock, __ATOMIC_ACQUIRE));
+    }
+}
+
+static void IRAM_ATTR core_spin_unlock_pair(core_t *a, core_t *b) {
+    __atomic_clear(&a->lock, __ATOMIC_RELEASE);
+    if (b != a) {
+        __atomic_clear(&b->lock, __ATOMIC_RELEASE);
+    }
+}
+
+static port_irq_state_t IRAM_ATTR core_lock(core_t *core) {
+    port_irq_state_t irq = port_irq_disable();
+    core_spin_lock_pair(core, core);
+    return irq;
+}
+
+// A context switch requested under the lock happens here, once interrupts are re-enabled
+static void IRAM_ATTR core_unlock(core_t *core, port_irq_state_t irq) {
+    core_spin_unlock_pair(core, core);
+    port_irq_restore(irq);
+}
+
+// With interrupts disabled: lock `core` and the core holding `task` (if any), retrying if the task
+// moves meanwhile. Returns the task's core.
+static core_t *IRAM_ATTR core_lock_home(core_t *core, task_t *task) {
+    while (1) {
+        core_t *home = task != NULL ? &cores[task->core] : core;
+        core_spin_lock_pair(core, home);
+        if (task == NULL || &cores[task->core] == home) return home;
+        core_spin_unlock_pair(core, home);
+    }
+}
+
+// Let another core's main loop know its queues changed
+static void scheduler_kick(int core) {
+    if (scheduler_running && core != port_core_id()) {
+        port_ipi_send(core);
+    }
+}
+
+// Task management
+static void task_entry(void);
+
+// Declared utilization of one core in parts per million, leaving out task `exclude`
+static uint64_t core_utilization_ppm(int core, int exclude, int *tasks) {
+    uint64_t utilization_ppm = 0;
+
+    *tasks = 0;
+    for (int i = 0; i < task_count; i++) {
+        task_t *task = &task_list[i];
+        if (i != exclude && task->core == core && task->state != TASK_TERMINATED && task->interval_ms > 0) {
+            utilization_ppm += ((uint64_t)task->wcet_us * 1000 + task->interval_ms - 1) / task->interval_ms;
+            (*tasks)++;
+        }
+    }
+    return utilization_ppm;
+}
+
+// Where a CORE_ANY task goes: the least utilized core, then the one with fewest tasks (partitioned scheduling)
+static int scheduler_pick_core(int exclude) {
+    int best = 0;
+    int best_tasks;
+    uint64_t best_ppm = core_utilization_ppm(0, exclude, &best_tasks);
+
+    for (int c = 1; c < NUM_CORES; c++) {
+        int tasks;
+        uint64_t ppm = core_utilization_ppm(c, exclude, &tasks);
+        if (ppm < best_ppm || (ppm == best_ppm && tasks < best_tasks)) {
+            best = c;
+            best_ppm = ppm;
+            best_tasks = tasks;
+        }
+    }
+    return best;
+}
+
+static admit_result_t scheduler_add(task_func_t func, coroutine_func_t co_func, void *param, uint32_t interval_ms,
+                                    int priority, uint32_t wcet_us) {
+    if (priority < 0 || priority >= MAX_PRIORITIES) {
+        ESP_LOGW("Scheduler", "Priority %d out of range", priority);
+        return ADMIT_ERR_PRIORITY;
+    }
+    if (task_count < MAX_TASKS && (co_func != NULL || stack_count < MAX_STACKS)) {
+        task_list[task_count].func = func;
+        task_list[task_count].co_func = co_func;
+        task_list[task_count].co.resume = 0;
+        task_list[task_count].param = param;
+        task_list[task_count].interval_ms = interval_ms;
+        task_list[task_count].deadline_ms = interval_ms;
+        task_list[task_count].wcet_us = wcet_us;
+        task_list[task_count].last_run = 0;
+        task_list[task_count].next_release = esp_timer_get_time() + (uint64_t)interval_ms * 1000; // One period after it is added
+        task_list[task_count].wheel.time = task_list[task_count].next_release;
+        task_list[task_count].max_jitter_us = 0;
+        task_list[task_count].jobs = 0;
+        task_list[task_count].deadline_misses = 0;
+        task_list[task_count].overruns = 0;
+        task_list[task_count].overrun_policy = OVERRUN_SKIP;
+        task_list[task_count].state = TASK_WAITING;
+        task_list[task_count].priority = priority;
+        task_list[task_count].base_priority = priority;
+        task_list[task_count].blocked_on = NULL;
+        task_list[task_count].held = NULL;
+        task_list[task_count].suspended = false;
+        task_list[task_count].affinity = CORE_ANY;
+        task_list[task_count].core = scheduler_pick_core(-1);
+        task_list[task_count].migration = MIGRATE_UNPINNED;
+        task_list[task_count].on_cpu = false;
+        task_list[task_count].heap_index = -1;
+        task_list[task_count].wheel.slot = -1;
+        task_list[task_count].prev_ready = -1;
+        task_list[task_count].next_ready = -1;
+        task_list[task_count].next_waiter = 0;
+        task_list[task_count].event_mask = 0;
+        task_list[task_count].triggered = false;
+        task_list[task_count].activation_pending = false;
+        task_list[task_count].activation_mask = 0;
+        task_list[task_count].next_activated = 0;
+
+        // Check the set including the new task before committing to it
+        task_count++;
+        if (admission_control && !scheduler_schedulable()) {
+            task_count--;
+            ESP_LOGW("Scheduler", "Task rejected: task set would not be schedulable");
+            return ADMIT_ERR_UNSCHEDULABLE;
+        }
+        task_count--;
+
+        int index = task_count;
+        core_t *home = &cores[task_list[index].core];
+        task_list[index].stack = NULL;
+        if (co_func == NULL) {
+            task_list[index].stack = task_stacks[stack_count++];
+            port_context_init(&task_list[index].context, task_list[index].stack, TASK_STACK_SIZE, task_entry);
+        }
+        port_irq_state_t irq = core_lock(home);
+        release_queue_push(&home->release_queue, &task_list[index].wheel);
+        task_count++;
+        core_unlock(home, irq);
+        scheduler_kick(task_list[index].core);
+        return ADMIT_OK;
+    } else {
+        ESP_LOGW("Scheduler", "Max tasks reached");
+        return ADMIT_ERR_MAX_TASKS;
+    }
+}
+
+admit_result_t scheduler_add_task(task_func_t func, void *param, uint32_t interval_ms, int priority, uint32_t wcet_us) {
+    return scheduler_add(func, NULL, param, interval_ms, priority, wcet_us);
+}
+
+// A stackless task: runs one job per release like scheduler_add_task(), but can wait inside the
+// job with the CO_AWAIT_* macros. Not preempted by the tick between awaits.
+admit_result_t scheduler_add_coroutine(coroutine_func_t func, void *param, uint32_t interval_ms, int priority, uint32_t wcet_us) {
+    return scheduler_add(NULL, func, param, interval_ms, priority, wcet_us);
+}
+
+void scheduler_remove_task(int index) {
+    if (index >= 0 && index < task_count) {
+        task_t *task = &task_list[index];
+        core_t *core = this_core();
+        port_irq_state_t irq = port_irq_disable();
+        core_t *home = core_lock_home(core, task);
+        if (task->state == TASK_READY) {
+            ready_remove(home, index);
+        } else if ((task->state == TASK_WAITING || task->state == TASK_BLOCKED) && task->wheel.slot != -1) {
+            release_queue_remove(&home->release_queue, &task->wheel);
+        }
+        task->state = TASK_TERMINATED;
+        core_spin_unlock_pair(core, home);
+        port_irq_restore(irq);
+    }
+}
+
+void scheduler_set_overrun_policy(int index, overrun_policy_t policy) {
+    if (index >= 0 && index < task_count) {
+        task_list[index].overrun_policy = policy;
+    }
+}
+
+admit_result_t scheduler_set_deadline(int index, uint32_t deadline_ms) {
+    if (index >= 0 && index < task_count) {
+        uint32_t previous = task_list[index].deadline_ms;
+        task_list[index].deadline_ms = deadline_ms;
+        if (admission_control && !scheduler_schedulable()) {
+            task_list[index].deadline_ms = previous;
+            ESP_LOGW("Scheduler", "Deadline rejected: task set would not be schedulable");
+            return ADMIT_ERR_UNSCHEDULABLE;
+        }
+    }
+    return ADMIT_OK;
+}
+
+// Move a task's queue entry to another core. A running task finishes its job where it is and is
+// released on the new core.
+static void scheduler_move_task(int index, int target) {
+    task_t *task = &task_list[index];
+    core_t *to = &cores[target];
+    port_irq_state_t irq = port_irq_disable();
+    core_t *from = core_lock_home(to, task);
+
+    if (task->state == TASK_READY) {
+        ready_remove(from, index);
+        task->core = target;
+        ready_push(to, index);
+    } else if ((task->state == TASK_WAITING || task->state == TASK_BLOCKED) && task->wheel.slot != -1) {
+        release_queue_remove(&from->release_queue, &task->wheel);
+        task->core = target;
+        release_queue_push(&to->release_queue, &task->wheel);
+    } else {
+        task->core = target;
+    }
+    core_spin_unlock_pair(to, from);
+    port_irq_restore(irq);
+    scheduler_kick(target);
+}
+
+// Pin a task to one core, or (CORE_ANY) let the scheduler place it on the least utilized core
+admit_result_t scheduler_set_affinity(int index, int core) {
+    if (core < CORE_ANY || core >= NUM_CORES) {
+        ESP_LOGW("Scheduler", "Core %d out of range", core);
+        return ADMIT_ERR_CORE;
+    }
+    if (index >= 0 && index < task_count) {
+        int previous = task_list[index].core;
+        int target = core != CORE_ANY ? core : scheduler_pick_core(index);
+        scheduler_move_task(index, target);
+        if (admission_control && !scheduler_schedulable()) {
+            scheduler_move_task(index, previous);
+            ESP_LOGW("Scheduler", "Affinity rejected: task set would not be schedulable");
+            return ADMIT_ERR_UNSCHEDULABLE;
+        }
+        task_list[index].affinity = core;
+    }
+    return ADMIT_OK;
+}
+
+// Declare that a task holds a ceiling mutex for at most length_us per job, so admission control
+// counts the blocking it causes higher-priority tasks. Declaring it again updates the length.
+// Rejected under SCHEDULER_EDF, which ignores ceilings, so the blocking bound does not hold.
+admit_result_t scheduler_set_critical_section(int index, mutex_t *mutex, uint32_t length_us) {
+    if (index < 0 || index >= task_count) return ADMIT_OK;
+    if (scheduler_type == SCHEDULER_EDF) {
+        ESP_LOGW("Scheduler", "Critical section rejected: EDF ignores mutex ceilings");
+        return ADMIT_ERR_CEILING;
+    }
+    if (mutex->ceiling == 0 || mutex->ceiling - 1 > task_list[index].base_priority) {
+        ESP_LOGW("Scheduler", "Critical section needs a ceiling at or above the task's priority");
+        return ADMIT_ERR_CEILING;
+    }
+
+    int s = 0;
+    while (s < critical_section_count &&
+           (critical_sections[s].task != index || critical_sections[s].mutex != mutex)) {
+        s++;
+    }
+    if (s == MAX_CRITICAL_SECTIONS) {
+        ESP_LOGW("Scheduler", "Max critical sections reached");
+        return ADMIT_ERR_MAX_SECTIONS;
+    }
+    uint32_t previous = s < critical_section_count ? critical_sections[s].length_us : 0;
+    critical_sections[s] = (critical_section_t){ .task = index, .mutex = mutex, .length_us = length_us };
+    if (s == critical_section_count) {
+        critical_section_count++;
+    }
+    if (admission_control && !scheduler_schedulable()) {
+        critical_sections[s].length_us = previous;
+        ESP_LOGW("Scheduler", "Critical section rejected: task set would not be schedulable");
+        return ADMIT_ERR_UNSCHEDULABLE;
+    }
+    return ADMIT_OK;
+}
+
+void scheduler_set_admission_control(bool enabled) {
+    admission_control = enabled;
+}
+
+// Call before scheduler_start(). Admission control still checks each core's own tasks only.
+void scheduler_set_work_stealing(bool enabled) {
+    work_stealing = enabled;
+}
+
+void scheduler_set_migration(int index, migration_t migration) {
+    if (index >= 0 && index < task_count) {
+        task_list[index].migration = migration;
+    }
+}
+
+// Release a task only when it is activated, by scheduler_activate(), scheduler_activate_from_isr() or
+// a source bound with scheduler_activate_on_*(), instead of every interval_ms. interval_ms becomes
+// the minimum time between its releases, which admission control uses as its period.
+void scheduler_set_triggered(int index) {
+    if (index >= 0 && index < task_count) {
+        task_t *task = &task_list[index];
+        port_irq_state_t irq = port_irq_disable();
+        core_t *core = this_core();
+        core_t *home = core_lock_home(core, task);
+        if (!task->triggered && task->state == TASK_WAITING && !task->suspended && task->wheel.slot != -1) {
+            release_queue_remove(&home->release_queue, &task->wheel); // Parked: the first activation releases it at once
+            task->next_release = 0;
+        }
+        task->triggered = true;
+        core_spin_unlock_pair(core, home);
+        port_irq_restore(irq);
+    }
+}
+
+// Activate a task whenever queue_send() adds an item to the queue. The task is its consumer.
+void scheduler_activate_on_queue(int index, queue_t *queue) {
+    if (index >= 0 && index < task_count) {
+        queue->activates = index + 1;
+        scheduler_set_triggered(index);
+    }
+}
+
+// Activate a task whenever the semaphore is given with no task blocked on it (call after semaphore_init())
+void scheduler_activate_on_semaphore(int index, semaphore_t *sem) {
+    if (index >= 0 && index < task_count) {
+        sem->activates = index + 1;
+        scheduler_set_triggered(index);
+    }
+}
+
+// Activate a task whenever any of the bits in mask is set. Several tasks can be bound to one group.
+void scheduler_activate_on_event(int index, event_group_t *group, uint32_t mask) {
+    if (index >= 0 && index < task_count && task_list[index].activation_mask == 0) {
+        task_list[index].activation_mask = mask;
+        task_list[index].next_activated = group->activates;
+        group->activates = index + 1;
+        scheduler_set_triggered(index);
+    }
+}
+
+// Admission control (uses the declared wcet_us; tasks without one are treated as free). Tasks are
+// partitioned, so every core is checked on its own.
+// Liu & Layland bound n(2^(1/n) - 1) in parts per million, ln 2 beyond the table
+static const uint32_t liu_layland_ppm[] = {
+    1000000, 1000000, 828427, 779763, 756828, 743492, 734772, 728627, 724062, 720538, 717735
+};
+
+static bool admission_active(const task_t *task, int core) {
+    return task->core == core && task->state != TASK_TERMINATED && task->wcet_us > 0;
+}
+
+// Effective relative deadline in us (never beyond the period)
+static uint64_t admission_deadline_us(const task_t *task) {
+    uint32_t deadline_ms = task->deadline_ms < task->interval_ms ? task->deadline_ms : task->interval_ms;
+    return (uint64_t)deadline_ms * 1000;
+}
+
+// Worst-case blocking by ceiling mutexes: under the immediate priority ceiling a task waits for at
+// most one critical section of a lower-priority task on its core, on a mutex whose ceiling is at
+// least its own priority, since the owner cannot be preempted by anything that needs the mutex
+static uint64_t admission_blocking_us(const task_t *task, int core) {
+    uint64_t blocking = 0;
+
+    for (int s = 0; s < critical_section_count; s++) {
+        critical_section_t *section = &critical_sections[s];
+        task_t *holder = &task_list[section->task];
+        if (admission_active(holder, core) && holder->base_priority > task->base_priority &&
+            section->mutex->ceiling - 1 <= task->base_priority && section->length_us > blocking) {
+            blocking = section->length_us;
+        }
+    }
+    return blocking;
+}
+
+// Interference on task i from the other tasks of its priority or higher on its core. Preemptive: the
+// jobs released in [0, t) (ceil). Non-preemptive, where t is a start time: those released in [0, t].
+static uint64_t admission_interference_us(int i, int core, uint64_t t, bool preemptive) {
+    uint64_t interference = 0;
+
+    for (int j = 0; j < task_count; j++) {
+        task_t *other = &task_list[j];
+        if (j == i || !admission_active(other, core) || other->base_priority > task_list[i].base_priority) continue;
+        uint64_t period = (uint64_t)other->interval_ms * 1000;
+        uint64_t jobs = preemptive ? (t + period - 1) / period : t / period + 1;
+        interference += jobs * other->wcet_us; // Equal priorities interfere too (FIFO order)
+    }
+    return interference;
+}
+
+// Response-time analysis for fixed priorities, exact when preemptive: R = C + B + sum(ceil(R / Tj) * Cj),
+// where B is the longest critical section a lower-priority task can block it with.
+// Non-preemptive, B is the longest lower-priority job, which may have started just before the release.
+// A job can then also be delayed by the previous job of its own task, so every job q of the level-i busy
+// period is checked: it starts at w = B + q * C + sum((floor(w / Tj) + 1) * Cj) and must finish by
+// q * T + D.
+static bool admission_response_time(int core, bool preemptive) {
+    uint64_t utilization_ppm = 0; // Rounded up, to bound the busy period
+
+    for (int i = 0; i < task_count; i++) {
+        if (admission_active(&task_list[i], core)) {
+            uint64_t period = (uint64_t)task_list[i].interval_ms * 1000;
+            utilization_ppm += (task_list[i].wcet_us * 1000000ULL + period - 1) / period;
+        }
+    }
+
+    for (int i = 0; i < task_count; i++) {
+        task_t *task = &task_list[i];
+        if (!admission_active(task, core)) continue;
+
+        uint64_t deadline = admission_deadline_us(task);
+        uint64_t blocking = admission_blocking_us(task, core);
+        for (int j = 0; !preemptive && j < task_count; j++) {
+            if (admission_active(&task_list[j], core) && task_list[j].base_priority > task->base_priority &&
+                task_list[j].wcet_us > blocking) {
+                blocking = task_list[j].wcet_us;
+            }
+        }
+
+        if (preemptive) {
+            uint64_t response = task->wcet_us + blocking;
+            while (1) {
+                uint64_t next = task->wcet_us + blocking + admission_interference_us(i, core, response, true);
+                if (next > deadline) return false;
+                if (next == response) break;
+                response = next;
+            }
+            continue;
+        }
+
+        // Level-i busy period: t = B + sum over the task and the interfering ones of ceil(t / Tj) * Cj.
+        // It ends if their utilization is below 1; at exactly 1 it does not once anything blocks.
+        uint64_t period = (uint64_t)task->interval_ms * 1000;
+        if (utilization_ppm >= 1000000 && blocking > 0) return false;
+        uint64_t busy = blocking + task->wcet_us;
+        while (1) {
+            uint64_t next = blocking + (busy + period - 1) / period * task->wcet_us +
+                            admission_interference_us(i, core, busy, true);
+            if (next == busy) break;
+            busy = next;
+        }
+
+        uint64_t jobs = (busy + period - 1) / period;
+        for (uint64_t q = 0; q < jobs; q++) {
+            uint64_t start = blocking + q * task->wcet_us;
+            while (1) {
+                uint64_t next = blocking + q * task->wcet_us + admission_interference_us(i, core, start, false);
+                if (next + task->wcet_us > q * period + deadline) return false;
+                if (next == start) break;
+                start = next;
+            }
+        }
+    }
+    return true;
+}
+
+// Whether every task on the core with a shorter period also has a higher priority, as the Liu &
+// Layland bound assumes
+static bool admission_rate_monotonic(int core) {
+    for (int i = 0; i < task_count; i++) {
+        if (!admission_active(&task_list[i], core)) continue;
+        for (int j = 0; j < task_count; j++) {
+            if (admission_active(&task_list[j], core) && task_list[j].interval_ms < task_list[i].interval_ms &&
+                task_list[j].base_priority >= task_list[i].base_priority) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Whether every task on one core can meet its deadline under the current scheduler type
+static bool core_schedulable(int core) {
+    uint64_t utilization_ppm = 0; // Both rounded up, so truncation never admits an overloaded core
+    uint64_t density_ppm = 0;
+    int n = 0;
+
+    for (int i = 0; i < task_count; i++) {
+        task_t *task = &task_list[i];
+        if (!admission_active(task, core)) continue;
+        if (task->interval_ms == 0 || admission_deadline_us(task) == 0) return false;
+        uint64_t deadline_us = admission_deadline_us(task);
+        utilization_ppm += ((uint64_t)task->wcet_us * 1000 + task->interval_ms - 1) / task->interval_ms;
+        density_ppm += ((uint64_t)task->wcet_us * 1000000 + deadline_us - 1) / deadline_us;
+        n++;
+    }
+    if (n == 0) return true;
+    if (utilization_ppm > 1000000) return false;
+
+    switch (scheduler_type) {
+        case SCHEDULER_EDF:
+            return density_ppm <= 1000000; // U <= 1 when deadlines equal periods
+        case SCHEDULER_PRIORITY:
+            return admission_response_time(core, false);
+        case SCHEDULER_PREEMPTIVE: {
+            uint32_t bound = n < (int)(sizeof(liu_layland_ppm) / sizeof(liu_layland_ppm[0])) ? liu_layland_ppm[n] : 693147;
+            if (utilization_ppm <= bound && density_ppm == utilization_ppm && critical_section_count == 0 &&
+                admission_rate_monotonic(core)) {
+                return true; // Sufficient for rate-monotonic priorities
+            }
+            return admission_response_time(core, true);
+        }
+        default:
+            return true; // RR/FCFS: no deadline guarantee beyond U <= 1
+    }
+}
+
+// Whether every task can meet its deadline on its core under the current scheduler type
+bool scheduler_schedulable(void) {
+    for (int c = 0; c < NUM_CORES; c++) {
+        if (!core_schedulable(c)) return false;
+    }
+    return true;
+}
+
+// Scheduler setup
+void scheduler_setup(scheduler_type_t type) {
+    scheduler_type = type;
+
+    for (int c = 0; c < NUM_CORES; c++) {
+        core_t *core = &cores[c];
+        for (int p = 0; p < MAX_PRIORITIES; p++) {
+            core->ready_lists[p].head = -1;
+            core->ready_lists[p].tail = -1;
+        }
+        core->ready_bitmap = 0;
+        release_queue_init(&core->release_queue);
+        core->deadline_heap.size = 0;
+        core->deadline_heap.key_offset = offsetof(task_t, deadline);
+        core->current_task = -1;
+        core->switched_out = -1;
+        core->steal_deque.top = 0;
+        core->steal_deque.bottom = 0;
+        core->rr_next = 0;
+        core->wake = false;
+        core->idle = false;
+    }
+}
+
+// Make a task just taken off the release queue ready: a new job, or the rest of one that waited
+static void IRAM_ATTR scheduler_release_task(core_t *core, int index) {
+    if (task_list[index].suspended) {
+        task_list[index].suspended = false; // Continues the same job
+    } else {
+        task_list[index].deadline = task_list[index].next_release + (uint64_t)task_list[index].deadline_ms * 1000;
+    }
+    task_list[index].state = TASK_READY;
+    ready_push(core, index);
+}
+
+// Move every task whose release (or wait) time has passed onto its priority's ready list (core locked)
+void IRAM_ATTR scheduler_release(core_t *core, uint64_t now) {
+    wheel_entry_t *entry;
+
+    while ((entry = release_queue_expire(&core->release_queue, now)) != NULL) {
+        scheduler_release_task(core, (task_t *)((uint8_t *)entry - offsetof(task_t, wheel)) - task_list);
+    }
+}
+
+// Advance next_release by whole periods so releases never drift with dispatch latency
+static void IRAM_ATTR scheduler_advance_release(task_t *task, uint64_t end) {
+    uint64_t interval_us = (uint64_t)task->interval_ms * 1000;
+
+    task->next_release += interval_us;
+    if (task->next_release >= end || interval_us == 0) return;
+
+    task->overruns++;
+    switch (task->overrun_policy) {
+        case OVERRUN_SKIP:
+            task->next_release += ((end - task->next_release) / interval_us + 1) * interval_us;
+            break;
+        case OVERRUN_CATCH_UP:
+            break;
+        case OVERRUN_REPHASE:
+            task->next_release = end + interval_us;
+            break;
+    }
+}
+
+// The last switch on this core has completed: its outgoing task may now run on other cores
+static void IRAM_ATTR scheduler_put_previous(core_t *core) {
+    int previous = core->switched_out;
+
+    if (previous != -1) {
+        core->switched_out = -1;
+        __atomic_store_n(&task_list[previous].on_cpu, false, __ATOMIC_RELEASE);
+    }
+}
+
+// Called with the core locked: request a switch from the running context to `to`, saving into
+// the context of task `from_task` (-1 = the main loop). It happens once interrupts are re-enabled.
+static void IRAM_ATTR scheduler_switch(core_t *core, int from_task, port_context_t *to) {
+    port_context_t *from = from_task != -1 ? &task_list[from_task].context : &core->scheduler_context;
+
+    scheduler_put_previous(core);
+    core->switched_out = from_task;
+    core->context_switch_start = port_cycle_count();
+    port_context_switch(from, to);
+}
+
+// Runs first in every context that was just switched in: releases the outgoing task to other cores
+// and records the switch latency. An interrupt can get in first, so new switches release it too.
+static void IRAM_ATTR scheduler_switched_in(void) {
+    core_t *core = this_core();
+    uint32_t start = core->context_switch_start;
+
+    scheduler_put_previous(core);
+    if (start == 0) return;
+
+    uint32_t cycles = port_cycle_count() - start;
+    core->context_switch_start = 0;
+    core->context_switch_stats.count++;
+    core->context_switch_stats.total_cycles += cycles;
+    if (cycles > core->context_switch_stats.max_cycles) {
+        core->context_switch_stats.max_cycles = cycles;
+    }
+}
+
+// Claim a task's context for this core, waiting out another core that is still saving it
+static void IRAM_ATTR scheduler_claim(core_t *core, task_t *task) {
+    scheduler_put_previous(core); // This core is done with its last outgoing task, which may be this one
+    while (__atomic_load_n(&task->on_cpu, __ATOMIC_ACQUIRE));
+    task->on_cpu = true;
+}
+
+// Called with this core and the task's core locked: account the finished job and park the task
+// until its next release
+static void scheduler_job_finish(core_t *core, core_t *home, task_t *task, uint64_t end) {
+    task->last_run = end / 1000;
+    task->jobs++;
+    core->jobs++;
+    if (end > task->deadline) {
+        task->deadline_misses++;
+    }
+    if (task->state != TASK_TERMINATED) { // Unless it removed itself
+        task->state = TASK_WAITING;
+        if (!task->triggered) {
+            scheduler_advance_release(task, end);
+        } else if (task->activation_pending) { // Activated during the job: release it again
+            task->activation_pending = false;
+            task->next_release += (uint64_t)task->interval_ms * 1000;
+            if (task->next_release < end) {
+                task->next_release = end;
+            }
+        } else {
+            task->next_release += (uint64_t)task->interval_ms * 1000; // Earliest next release
+            return; // Parked until activated
+        }
+        task->wheel.time = task->next_release;
+        release_queue_push(&home->release_queue, &task->wheel);
+        if (home != core) {
+            port_ipi_send(home - cores); // Taken once we drop the locks
+        }
+    }
+}
+
+// Worst delay between a job's release and the start of its execution
+static void scheduler_record_jitter(task_t *task) {
+    uint64_t now = esp_timer_get_time();
+    if (now - task->next_release > task->max_jitter_us) {
+        task->max_jitter_us = now - task->next_release;
+    }
+}
+
+// Park the finished job on its core's release queue and return to this core's main loop
+static void scheduler_job_done(task_t *task) {
+    uint64_t end = esp_timer_get_time();
+    port_irq_state_t irq = port_irq_disable();
+    core_t *core = this_core();
+    core_t *home = core_lock_home(core, task);
+
+    scheduler_job_finish(core, home, task, end);
+    core->current_task = -1;
+    scheduler_switch(core, task - task_list, &core->scheduler_context);
+    core_spin_unlock_pair(core, home);
+    port_irq_restore(irq);
+}
+
+// Called with this core and the task's core locked: take the task off the CPU in the middle of its
+// job, back onto the ready list (wake_us == 0) or asleep until wake_us
+static void scheduler_suspend_job(core_t *core, core_t *home, task_t *task, uint64_t wake_us) {
+    if (task->state == TASK_TERMINATED) return; // It removed itself
+    if (wake_us == 0) {
+        task->state = TASK_READY;
+        ready_push(home, task - task_list);
+    } else {
+        task->state = TASK_WAITING;
+        task->suspended = true;
+        task->wheel.time = wake_us;
+        release_queue_push(&home->release_queue, &task->wheel);
+    }
+    if (home != core) {
+        port_ipi_send(home - cores);
+    }
+}
+
+// Switch the calling stackful task out as scheduler_suspend_job() describes; returns once it runs
+// again. Returns false without waiting when not called from a stackful task.
+static bool task_suspend(uint64_t wake_us) {
+    port_irq_state_t irq = port_irq_disable();
+    core_t *core = this_core(); // Read with interrupts off: a preempted task may resume on another core
+    int index = core->current_task;
+
+    if (task_current() == -1) {
+        port_irq_restore(irq);
+        return false;
+    }
+    task_t *task = &task_list[index];
+    core_t *home = core_lock_home(core, task);
+    scheduler_suspend_job(core, home, task, wake_us);
+    core->current_task = -1;
+    scheduler_switch(core, index, &core->scheduler_context);
+    core_spin_unlock_pair(core, home);
+    port_irq_restore(irq); // The switch happens here
+    scheduler_switched_in();
+    return true;
+}
+
+// With interrupts disabled: the calling task if it is a stackful one, the only kind that can block.
+// -1 for the main loop, a coroutine, or before scheduler_setup().
+static int task_current(void) {
+    int index = this_core()->current_task;
+    return index >= 0 && index < task_count && task_list[index].co_func == NULL ? index : -1;
+}
+
+// Whether a task is running on a core other than the caller's
+static bool task_running_elsewhere(int index) {
+    if (index == -1) return false;
+    int core = task_list[index].core;
+    return &cores[core] != this_core() && cores[core].current_task == index;
+}
+
+// With interrupts disabled and `lock` held: block the calling stackful task on `waiters` until
+// task_wake(), or until wake_us unless that is WAIT_FOREVER_US. Drops `lock` and restores `irq` once
+// the task is switched out, and returns true after it runs again. A task that timed out is still on
+// `waiters` for the caller to remove. Returns false at once, still locked, outside a stackful task.
+static bool task_block(wait_list_t *waiters, volatile bool *lock, port_irq_state_t irq, uint64_t wake_us) {
+    core_t *core = this_core();
+    int index = core->current_task;
+
+    if (task_current() == -1) return false;
+    task_t *task = &task_list[index];
+    core_t *home = core_lock_home(core, task);
+    wait_list_insert(waiters, index);
+    if (task->state != TASK_TERMINATED) {
+        task->state = TASK_BLOCKED;
+        if (wake_us != WAIT_FOREVER_US) { // Released like a delayed task if nobody wakes it first
+            task->suspended = true;
+            task->wheel.time = wake_us;
+            release_queue_push(&home->release_queue, &task->wheel);
+        }
+    }
+    core->current_task = -1;
+    scheduler_switch(core, index, &core->scheduler_context);
+    core_spin_unlock_pair(core, home);
+    spin_unlock(lock);
+    port_irq_restore(irq); // The switch happens here
+    scheduler_switched_in();
+    return true;
+}
+
+// With interrupts disabled and the object locked: make a task just taken off its wait list ready.
+// Returns false if the task was removed while blocked.
+static bool IRAM_ATTR task_wake(int index) {
+    task_t *task = &task_list[index];
+    core_t *core = this_core();
+    core_t *home = core_lock_home(core, task);
+    bool woken = task->state == TASK_BLOCKED;
+
+    if (woken) {
+        if (task->suspended) { // Blocked with a timeout
+            release_queue_remove(&home->release_queue, &task->wheel);
+            task->suspended = false;
+        }
+        task->state = TASK_READY;
+        ready_push(home, index);
+        if (home != core) {
+            port_ipi_send(home - cores); // Preempts there in preemptive modes
+        } else {
+            core->wake = true; // Woken from an interrupt while the main loop waits
+        }
+    }
+    core_spin_unlock_pair(core, home);
+    return woken;
+}
+
+// Release an event-triggered task: at once if it is parked between jobs and its minimum interval
+// has passed, else when it has. A task in the middle of a job gets one more job after it, however
+// often it is activated meanwhile. Returns true if it became ready at once.
+static bool IRAM_ATTR task_activate(int index) {
+    task_t *task = &task_list[index];
+    port_irq_state_t irq = port_irq_disable();
+    core_t *core = this_core();
+    core_t *home = core_lock_home(core, task);
+    uint64_t now = esp_timer_get_time();
+    bool queued = false;
+    bool woken = false;
+
+    if (!task->triggered || task->state == TASK_TERMINATED) {
+        // Not bound to an activation source
+    } else if (task->state != TASK_WAITING || task->suspended) {
+        task->activation_pending = true;
+    } else if (task->wheel.slot != -1) {
+        // Its release is already due, and its job will see this activation
+    } else if (task->next_release > now) {
+        task->wheel.time = task->next_release;
+        release_queue_push(&home->release_queue, &task->wheel);
+        queued = true;
+    } else {
+        task->next_release = now;
+        task->deadline = now + (uint64_t)task->deadline_ms * 1000;
+        task->state = TASK_READY;
+        ready_push(home, index);
+        queued = true;
+        woken = true;
+    }
+    if (queued) {
+        if (home != core) {
+            port_ipi_send(home - cores);
+        } else {
+            core->wake = true;
+        }
+    }
+    core_spin_unlock_pair(core, home);
+    port_irq_restore(irq);
+    return woken;
+}
+
+// Activate an event-triggered task (see scheduler_set_triggered()) from a task
+void scheduler_activate(int index) {
+    if (index >= 0 && index < task_count && task_activate(index)) {
+        task_yield_if_preempted();
+    }
+}
+
+// scheduler_activate() for interrupt handlers. Returns true if the task became ready; end the
+// handler with scheduler_yield_from_isr() then.
+bool IRAM_ATTR scheduler_activate_from_isr(int index) {
+    return index >= 0 && index < task_count && task_activate(index);
+}
+
+// Add the task that runs every software timer's callbacks, at `priority`. For admission control,
+// wcet_us bounds the callback time in any interval_ms; 0 and 0 leave the service out. Its one job
+// starts interval_ms after the scheduler and never finishes, so under EDF it keeps that job's deadline.
+admit_result_t scheduler_add_timer_service(int priority, uint32_t interval_ms, uint32_t wcet_us) {
+    if (timer_service.task != -1) return ADMIT_OK; // Already added
+    admit_result_t result = scheduler_add_task(timer_service_task, NULL, interval_ms, priority, wcet_us);
+    if (result == ADMIT_OK) {
+        timer_service.task = task_count - 1;
+    }
+    return result;
+}
+
+// With interrupts disabled and mutex_chain_lock held: change a task's effective priority, moving it
+// within the ready list or mutex wait list that holds it
+static void task_set_priority(int index, int priority) {
+    task_t *task = &task_list[index];
+    core_t *core = this_core();
+    core_t *home = core_lock_home(core, task);
+
+    if (task->priority != priority) {
+        if (task->state == TASK_READY) {
+            ready_remove(home, index);
+            task->priority = priority;
+            ready_push(home, index);
+            if (home != core) {
+                port_ipi_send(home - cores); // It may now preempt there
+            }
+        } else if (task->state == TASK_BLOCKED && task->blocked_on != NULL) {
+            wait_list_remove(&task->blocked_on->waiters, index);
+            task->priority = priority;
+            wait_list_insert(&task->blocked_on->waiters, index);
+        } else {
+            task->priority = priority;
+        }
+    }
+    core_spin_unlock_pair(core, home);
+}
+
+// After waking a task or lowering the caller's priority: in preemptive modes, switch now if a ready
+// task on this core outranks the caller
+static void task_yield_if_preempted(void) {
+    if (!scheduler_preemptive()) return;
+
+    port_irq_state_t irq = port_irq_disable();
+    core_t *core = this_core();
+    core_spin_lock_pair(core, core);
+    int running = core->current_task;
+    int next = ready_highest(core);
+    bool yield = running != -1 && next != -1 && ready_preempts(next, running);
+    core_unlock(core, irq);
+    if (yield) {
+        task_yield();
+    }
+}
+
+// Sleep until esp_timer_get_time() reaches wake_us, leaving the CPU to other tasks. The job's deadline
+// still applies. Outside a stackful task (e.g. before scheduler_start()) this busy-waits instead.
+void task_delay_until(uint64_t wake_us) {
+    uint64_t now = esp_timer_get_time();
+
+    if (wake_us <= now) return;
+    if (!task_suspend(wake_us)) {
+        esp_rom_delay_us(wake_us - now);
+    }
+}
+
+void task_delay_ms(uint32_t ms) {
+    task_delay_until(esp_timer_get_time() + (uint64_t)ms * 1000);
+}
+
+// Let other ready tasks of the same or higher priority run first
+void task_yield(void) {
+    task_suspend(0);
+}
+
+// Every task runs on its own stack, one job per release
+static void task_entry(void) {
+    scheduler_switched_in();
     while (1) {
+        task_t *task = &task_list[this_core()->current_task];
+        scheduler_record_jitter(task);
+        task->func(task->param);
+
+        scheduler_job_done(task);
+        scheduler_switched_in();
+    }
+}
+
+// Called with the core locked: switch into a task until it finishes its job (or blocks). A coroutine
+// needs no switch; scheduler_run() calls it once the core is unlocked.
+void scheduler_dispatch(core_t *core, int index) {
+    task_t *task = &task_list[index];
+
+    if (task->state == TASK_READY) {
+        ready_remove(core, index);
+    }
+    task->state = TASK_RUNNING;
+    core->current_task = index;
+    if (task->co_func != NULL) return;
+    scheduler_claim(core, task);
+    scheduler_switch(core, -1, &task->context);
+}
+
+// Run a coroutine task from the main loop until its next await or the end of its job
+static void scheduler_resume_coroutine(core_t *core, task_t *task) {
+    if (task->co.resume == 0) {
+        scheduler_record_jitter(task);
+    }
+    co_status_t status = task->co_func(&task->co, task->param);
+    uint64_t now = esp_timer_get_time();
+    port_irq_state_t irq = port_irq_disable();
+    core_t *home = core_lock_home(core, task);
+
+    core->current_task = -1;
+    if (status == CO_DONE) {
+        scheduler_job_finish(core, home, task, now);
+    } else {
+        scheduler_suspend_job(core, home, task, status == CO_YIELDED ? 0 : now + task->co.wait_us);
+    }
+    core_spin_unlock_pair(core, home);
+    port_irq_restore(irq);
+}
+
+// With interrupts disabled and no core locked: take a ready job offered by another core. Returns
+// the task (or -1) with this core and *victim locked (*victim is this core if nothing was taken).
+static int scheduler_steal(core_t *core, core_t **victim) {
+    for (int n = 1; n < NUM_CORES; n++) {
+        core_t *other = &cores[(core - cores + n) % NUM_CORES];
+        int index;
+        while ((index = steal_deque_steal(&other->steal_deque)) != -1) {
+            task_t *task = &task_list[index];
+            core_spin_lock_pair(core, other);
+            if (task->state == TASK_READY && task->core == other - cores && task_stealable(task)) {
+                ready_remove(other, index);
+                if (task->affinity == CORE_ANY) {
+                    task->core = core - cores; // Unpinned tasks stay with the thief
+                }
+                task->state = TASK_RUNNING;
+                core->steals++;
+                *victim = other;
+                return index;
+            }
+            core_spin_unlock_pair(core, other); // Already dispatched by its core: a stale entry
+        }
+    }
+    core_spin_lock_pair(core, core);
+    *victim = core;
+    return -1;
+}
+
+// Called with the core locked: if it still has jobs to offer, wake an idle core to steal them
+static void IRAM_ATTR scheduler_offer(core_t *core) {
+    steal_deque_t *deque = &core->steal_deque;
+
+    if (deque->bottom - __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE) <= 0) return;
+    for (int c = 0; c < NUM_CORES; c++) {
+        if (&cores[c] != core && cores[c].idle) {
+            cores[c].idle = false;
+            port_ipi_send(c);
+            return;
+        }
+    }
+}
+
+// Scheduler run function: one pass of this core's main loop
+void scheduler_run(void) {
+    core_t *core = this_core();
+    port_irq_state_t irq = core_lock(core);
+    core_t *victim = core;
+    uint64_t now = esp_timer_get_time(); // Get time in microseconds
+    int next = -1;
+
+    scheduler_release(core, now);
+    switch (scheduler_type) {
+        case SCHEDULER_RR: {
+            for (int n = 0; n < task_count; n++) {
+                int i = (core->rr_next + n) % task_count;
+                if (task_list[i].state == TASK_READY && task_list[i].core == core - cores) {
+                    next = i;
+                    core->rr_next = (i + 1) % task_count;
+                    break;
+                }
+            }
+            break;
+        }
+
+        case SCHEDULER_FCFS: {
+            for (int i = 0; i < task_count; i++) {
+                if (task_list[i].state == TASK_READY && task_list[i].core == core - cores) {
+                    next = i; // Run the first ready task
+                    break;
+                }
+            }
+            break;
+        }
+
+        case SCHEDULER_PRIORITY:
+        case SCHEDULER_PREEMPTIVE:
+        case SCHEDULER_EDF: {
+            // The timer ISR additionally preempts the running task in preemptive and EDF modes
+            next = ready_highest(core);
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    if (next == -1 && work_stealing) {
+        core_spin_unlock_pair(core, core);
+        next = scheduler_steal(core, &victim);
+    }
+    if (next != -1) {
+        scheduler_dispatch(core, next);
+        if (work_stealing) {
+            scheduler_offer(core);
+        }
+    }
+    core_spin_unlock_pair(core, victim);
+    port_irq_restore(irq); // The switch happens here
+    if (next != -1 && task_list[next].co_func != NULL) {
+        scheduler_resume_coroutine(core, &task_list[next]);
+    } else if (next != -1) {
+        scheduler_switched_in();
+    }
+}
+
+// Time at which scheduler_run() next has work on this core: now if a task is already ready,
+// otherwise the earliest pending release
+uint64_t scheduler_next_wakeup(void) {
+    core_t *core = this_core();
+
+    if (core->ready_bitmap != 0 || core->deadline_heap.size != 0) return 0;
+    return release_queue_next_time(&core->release_queue);
+}
+
+// Called with interrupts disabled when the main loop stops waiting for work, or is preempted while it waits
+static void IRAM_ATTR scheduler_idle_end(core_t *core) {
+    core->idle = false;
+    if (core->idle_since != 0) {
+        core->idle_us += esp_timer_get_time() - core->idle_since;
+        core->idle_since = 0;
+    }
+}
+
+// Each core's main loop: sleep exactly until its next task release, or until another core kicks it
+static void scheduler_core_main(int index) {
+    core_t *core = &cores[index];
+
+    port_core_setup(scheduler_ipi_isr);
+    if (scheduler_preemptive() || work_stealing) { // Stealing also needs releases while a long job runs
+        port_timer_start(TICK_PERIOD_US, timer_isr);
+    }
+    while (scheduler_running && port_running()) {
         scheduler_run();
-        esp_rom_delay_us(100 * 1000); // Small delay to avoid busy-waiting
+        core->idle_since = esp_timer_get_time();
+        core->idle = true;
+        port_wait_until(scheduler_next_wakeup(), &core->wake);
+        port_irq_state_t irq = port_irq_disable();
+        scheduler_idle_end(core);
+        port_irq_restore(irq);
+    }
+    port_core_exit();
+}
+
+// Run the scheduler on every core; returns once scheduler_stop() is called (or the simulation ends)
+void scheduler_start(void) {
+    int self = port_core_id();
+
+    scheduler_running = true;
+    scheduler_start_time = esp_timer_get_time();
+    for (int c = 0; c < NUM_CORES; c++) {
+        if (c != self) port_core_start(c, scheduler_core_main);
+    }
+    scheduler_core_main(self);
+    for (int c = 0; c < NUM_CORES; c++) {
+        if (c != self) port_core_join(c);
+    }
+}
+
+void scheduler_stop(void) {
+    scheduler_running = false;
+    for (int c = 0; c < NUM_CORES; c++) {
+        if (c != port_core_id()) port_ipi_send(c);
+    }
+}
+
+void scheduler_log_stats(void) {
+    uint64_t elapsed_us = esp_timer_get_time() - scheduler_start_time;
+
+    for (int i = 0; i < task_count; i++) {
+        ESP_LOGI("Scheduler", "Task %d: max release jitter %llu us, %u/%u deadlines missed, %u overruns", i,
+                 (unsigned long long)task_list[i].max_jitter_us, (unsigned)task_list[i].deadline_misses,
+                 (unsigned)task_list[i].jobs, (unsigned)task_list[i].overruns);
+    }
+    for (int c = 0; c < NUM_CORES; c++) {
+        context_switch_stats_t *stats = &cores[c].context_switch_stats;
+        ESP_LOGI("Scheduler", "Core %d: %u jobs, %u stolen, idle %u ms/s", c, (unsigned)cores[c].jobs,
+                 (unsigned)cores[c].steals, (unsigned)(elapsed_us > 0 ? cores[c].idle_us * 1000 / elapsed_us : 0));
+        if (stats->count > 0) {
+            uint32_t avg = (uint32_t)(stats->total_cycles / stats->count);
+            ESP_LOGI("Scheduler", "Core %d context switch: avg %u cycles (%u ns), max %u cycles (%u ns), %u switches", c,
+                     (unsigned)avg, (unsigned)((uint64_t)avg * 1000 / PORT_CYCLES_PER_US),
+                     (unsigned)stats->max_cycles,
+                     (unsigned)((uint64_t)stats->max_cycles * 1000 / PORT_CYCLES_PER_US),
+                     (unsigned)stats->count);
+        }
+    }
+}
+
+// Called from an interrupt: release due tasks and, if a more urgent task is ready, suspend the
+// running one (or the main loop) and switch to it
+static void IRAM_ATTR scheduler_preempt_from_isr(core_t *core) {
+    port_irq_state_t irq = port_irq_disable();
+    int running = core->current_task;
+    core_t *home = core_lock_home(core, running != -1 ? &task_list[running] : NULL);
+    port_context_t *from = NULL;
+    port_context_t *to = NULL;
+
+    scheduler_release(core, esp_timer_get_time());
+    int highest_priority_task = ready_highest(core);
+    if (!scheduler_preemptive()) {
+        if (highest_priority_task != -1 && running == -1) {
+            core->wake = true; // Released while the main loop waits
+        }
+    } else if (highest_priority_task != -1 && running != -1 && task_list[running].co_func != NULL) {
+        // A coroutine shares the main loop's stack, so it keeps the CPU until its next await
+    } else if (highest_priority_task != -1 && running == -1 && task_list[highest_priority_task].co_func != NULL) {
+        core->wake = true; // Coroutines only run from the main loop, which dispatches it next
+    } else if (highest_priority_task != -1 && (running == -1 || ready_preempts(highest_priority_task, running))) {
+        from = &core->scheduler_context;
+        if (running != -1) {
+            from = &task_list[running].context;
+            task_list[running].state = TASK_READY; // Put the current task back to ready state
+            ready_push(home, running);
+        } else {
+            scheduler_idle_end(core); // Busy until the main loop runs again
+        }
+        core->wake = true; // The main loop re-checks its queues once it is resumed
+        if (task_list[highest_priority_task].co_func != NULL) {
+            to = &core->scheduler_context; // Resume the main loop to dispatch the coroutine
+            core->current_task = -1;
+        } else {
+            ready_remove(core, highest_priority_task);
+            task_list[highest_priority_task].state = TASK_RUNNING;
+            scheduler_claim(core, &task_list[highest_priority_task]);
+            core->current_task = highest_priority_task;
+            to = &task_list[highest_priority_task].context;
+        }
+        core->switched_out = running;
+        core->context_switch_start = port_cycle_count();
+    }
+    if (work_stealing) {
+        scheduler_offer(core);
+    }
+    core_spin_unlock_pair(core, home);
+    port_irq_restore(irq);
+    if (from != NULL && home != core) {
+        port_ipi_send(home - cores); // The preempted task belongs to another core now
+    }
+    if (from != NULL) {
+        port_context_switch_from_isr(from, to);
+        scheduler_switched_in();
+    }
+}
+
+// Timer ISR: releases due tasks, and preempts in preemptive and EDF modes (one per core)
+void IRAM_ATTR timer_isr(void *arg) {
+    // Clear the interrupt
+    port_timer_ack();
+
+    // Check for higher-priority tasks
+    scheduler_preempt_from_isr(this_core());
+}
+
+// Last step of an interrupt handler that woke a task: in preemptive modes, switch to it now if it
+// outranks the interrupted task
+void IRAM_ATTR scheduler_yield_from_isr(void) {
+    if (scheduler_preemptive()) {
+        scheduler_preempt_from_isr(this_core());
+    }
+}
+
+// Inter-processor interrupt: another core changed this core's queues
+void IRAM_ATTR scheduler_ipi_isr(void) {
+    core_t *core = this_core();
+
+    core->wake = true;
+    if (scheduler_preemptive()) {
+        scheduler_preempt_from_isr(core);
+    }
+}
+
+// Port functions
+#ifdef ESP_PLATFORM
+void port_timer_start(uint64_t period_us, void (*isr)(void *)) {
+    timer_config_t timer_config = {
+        .divider = 80, // 1 MHz timer (80 MHz / 80)
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_EN,
+        .auto_reload = TIMER_AUTORELOAD_EN
+    };
+    timer_init(TIMER_GROUP, TIMER_IDX, &timer_config);
+    timer_set_counter_value(TIMER_GROUP, TIMER_IDX, 0);
+    timer_set_alarm_value(TIMER_GROUP, TIMER_IDX, period_us);
+    timer_enable_intr(TIMER_GROUP, TIMER_IDX);
+    timer_isr_register(TIMER_GROUP, TIMER_IDX, isr, NULL, ESP_INTR_FLAG_IRAM, NULL); // Routed to the calling core
+    timer_start(TIMER_GROUP, TIMER_IDX);
+}
+
+void IRAM_ATTR port_timer_ack(void) {
+    timer_group_clr_intr_status_in_isr(TIMER_GROUP, TIMER_IDX);
+    timer_group_enable_alarm_in_isr(TIMER_GROUP, TIMER_IDX);
+}
+
+#define PORT_WATCHDOG_FEED_US (1000 * 1000) // Longest sleep between feeds, well inside the watchdog timeout
+
+// The IPI rides on the target core's wake alarm, whose interrupt is allocated on that core: the sender
+// flags it and sets the alarm to 0, below the running count, so it fires at once. This leaves the
+// FROM_CPU lines to esp_ipc_isr and needs no sdkconfig changes.
+static void (*port_ipi_handler)(void);
+static volatile bool port_ipi_pending[NUM_CORES];
+
+static void IRAM_ATTR port_alarm_isr(void *arg) {
+    int core = port_core_id();
+    timer_group_clr_intr_status_in_isr(ALARM_GROUP, (timer_idx_t)core);
+    if (__atomic_exchange_n(&port_ipi_pending[core], false, __ATOMIC_SEQ_CST)) {
+        port_ipi_handler();
+    } // Otherwise a wait's deadline: waking the core is all it does
+}
+
+void IRAM_ATTR port_ipi_send(int core) {
+    __atomic_store_n(&port_ipi_pending[core], true, __ATOMIC_SEQ_CST);
+    timer_group_set_alarm_value_in_isr(ALARM_GROUP, (timer_idx_t)core, 0);
+    timer_group_enable_alarm_in_isr(ALARM_GROUP, (timer_idx_t)core);
+}
+
+// Sleep in `waiti` until deadline_us or until the IPI sets *wake, with a one-shot alarm for the
+// deadline. Interrupts stay disabled from checking *wake until `waiti 0`, which re-enables them as it
+// sleeps, so an IPI in between is not missed. Re-arming the alarm may overwrite an IPI sent just
+// before it, so the pending flag is checked once the alarm is set. The main loop never blocks, so
+// IDLE never runs on this core; the loop feeds the task watchdog in its place.
+void port_wait_until(uint64_t deadline_us, volatile bool *wake) {
+    timer_idx_t alarm = (timer_idx_t)port_core_id();
+    port_irq_state_t irq = port_irq_disable();
+
+    while (!*wake) {
+        uint64_t now = esp_timer_get_time();
+        if (now >= deadline_us) break;
+        uint64_t wait_us = deadline_us - now < PORT_WATCHDOG_FEED_US ? deadline_us - now : PORT_WATCHDOG_FEED_US;
+        uint64_t count;
+        esp_task_wdt_reset();
+        timer_get_counter_value(ALARM_GROUP, alarm, &count);
+        timer_set_alarm_value(ALARM_GROUP, alarm, count + wait_us);
+        timer_set_alarm(ALARM_GROUP, alarm, TIMER_ALARM_EN);
+        if (__atomic_exchange_n(&port_ipi_pending[alarm], false, __ATOMIC_SEQ_CST)) break; // Its alarm was overwritten
+        __asm__ volatile("waiti 0"); // Until the alarm, the IPI or any other interrupt
+        port_irq_disable();
+    }
+    port_irq_restore(irq);
+    *wake = false;
+}
+
+bool port_running(void) {
+    return true;
+}
+
+// Cores. Core 1 runs its main loop inside a FreeRTOS task pinned to it, as core 0 does inside the
+// app_main task.
+static void (*port_core_entry)(int);
+static volatile bool port_core_active[NUM_CORES];
+
+static void port_core_task(void *arg) {
+    int core = (int)(intptr_t)arg;
+    port_core_entry(core);
+    port_core_active[core] = false;
+    vTaskDelete(NULL);
+}
+
+void port_core_start(int core, void (*entry)(int)) {
+    port_core_entry = entry;
+    port_core_active[core] = true;
+    xTaskCreatePinnedToCore(port_core_task, "rtos_core", TASK_STACK_SIZE, (void *)(intptr_t)core,
+                            uxTaskPriorityGet(NULL), NULL, core);
+}
+
+void port_core_join(int core) {
+    while (port_core_active[core]) {
+        vTaskDelay(1);
+    }
+}
+
+// Context switching. The level-1 interrupt entry saves the interrupted registers as an XtExcFrame
+// on the running stack and stores that stack pointer in the current FreeRTOS TCB (the task hosting
+// this core's main loop); the interrupt exit restores whichever frame the TCB points at. Swapping
+// that pointer inside an ISR therefore resumes a different task. Task bodies must not use the FPU,
+// whose registers are only saved per FreeRTOS task.
+extern void _xt_user_exit(void);
+
+static intr_handle_t port_yield_handle[NUM_CORES];
+static uint32_t port_yield_mask[NUM_CORES];
+static port_context_t *volatile port_pending_from[NUM_CORES];
+static port_context_t *volatile port_pending_to[NUM_CORES];
+
+static inline uint32_t **IRAM_ATTR port_saved_frame(void) {
+    return (uint32_t **)xTaskGetCurrentTaskHandle(); // pxTopOfStack is the first TCB member
+}
+
+static void IRAM_ATTR port_apply_pending_switch(void) {
+    int core = port_core_id();
+    if (port_pending_to[core] == NULL) return;
+    uint32_t **frame = port_saved_frame();
+    port_pending_from[core]->frame = *frame;
+    *frame = port_pending_to[core]->frame;
+    port_pending_to[core] = NULL;
+}
+
+static void IRAM_ATTR port_yield_isr(void *arg) {
+    xt_set_intclear(port_yield_mask[port_core_id()]);
+    port_apply_pending_switch();
+}
+
+// Called on each core before it starts scheduling: interrupts are allocated on the calling core. The
+// task watchdog watches the main loop instead of IDLE, which cannot run below it.
+void port_core_setup(void (*ipi_isr)(void)) {
+    int core = port_core_id();
+    timer_config_t alarm_config = {
+        .divider = 80, // 1 MHz, free running; waits set alarms relative to it
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_DIS,
+        .auto_reload = TIMER_AUTORELOAD_DIS
+    };
+
+    port_ipi_handler = ipi_isr;
+    esp_task_wdt_add(NULL);
+    esp_task_wdt_delete(xTaskGetIdleTaskHandleForCPU(core));
+    if (port_yield_handle[core] != NULL) return;
+    esp_intr_alloc(ETS_INTERNAL_SW0_INTR_SOURCE, ESP_INTR_FLAG_IRAM, port_yield_isr, NULL, &port_yield_handle[core]);
+    port_yield_mask[core] = 1u << esp_intr_get_intno(port_yield_handle[core]);
+    timer_init(ALARM_GROUP, (timer_idx_t)core, &alarm_config);
+    timer_enable_intr(ALARM_GROUP, (timer_idx_t)core);
+    timer_isr_register(ALARM_GROUP, (timer_idx_t)core, port_alarm_isr, NULL, ESP_INTR_FLAG_IRAM, NULL);
+    timer_start(ALARM_GROUP, (timer_idx_t)core);
+}
+
+// Called on each core once its main loop has returned: the watchdog goes back to IDLE
+void port_core_exit(void) {
+    esp_task_wdt_add(xTaskGetIdleTaskHandleForCPU(port_core_id()));
+    esp_task_wdt_delete(NULL);
+}
+
+// Build the same initial frame FreeRTOS gives a new task, so the first switch "returns" into entry()
+void port_context_init(port_context_t *context, uint8_t *stack, size_t size, void (*entry)(void)) {
+    uint32_t sp = ((uint32_t)stack + size - XT_STK_FRMSZ) & ~0xf;
+    XtExcFrame *frame = (XtExcFrame *)sp;
+
+    memset(frame, 0, XT_STK_FRMSZ);
+    frame->pc = (uint32_t)entry;
+    frame->a0 = 0; // Terminates backtraces
+    frame->a1 = sp + XT_STK_FRMSZ;
+    frame->exit = (uint32_t)_xt_user_exit;
+    frame->ps = PS_UM | PS_EXCM | PS_WOE | PS_CALLINC(1); // As if entry() had been reached by call4
+    context->frame = (uint32_t *)frame;
+}
+
+// Callers hold interrupts disabled; the yield interrupt (and so the switch) fires when they re-enable them
+void IRAM_ATTR port_context_switch(port_context_t *from, port_context_t *to) {
+    int core = port_core_id();
+    port_pending_from[core] = from;
+    port_pending_to[core] = to;
+    xt_set_intset(port_yield_mask[core]);
+}
+
+void IRAM_ATTR port_context_switch_from_isr(port_context_t *from, port_context_t *to) {
+    port_apply_pending_switch(); // A yield requested just before this interrupt was taken
+    uint32_t **frame = port_saved_frame();
+    from->frame = *frame;
+    *frame = to->frame;
+}
+#else
+#ifndef RTOS_VIRTUAL_CLOCK
+static void (*host_timer_isr)(void *);
+static void (*host_ipi_isr)(void);
+static pthread_t host_core_threads[NUM_CORES];
+static volatile bool host_core_ready[NUM_CORES]; // Signal handlers installed, so the IPI can be sent
+static void (*host_core_entry)(int);
+
+static void host_timer_signal(int sig) {
+    (void)sig;
+    host_timer_isr(NULL);
+}
+
+static void host_ipi_signal(int sig) {
+    (void)sig;
+    host_ipi_isr();
+}
+
+static void *host_core_thread(void *arg) {
+    host_core_id = (int)(intptr_t)arg;
+    host_core_entry(host_core_id);
+    return NULL;
+}
+#endif
+
+// Each core's tick is a timer that signals that core's thread
+void port_timer_start(uint64_t period_us, void (*isr)(void *)) {
+#ifdef RTOS_VIRTUAL_CLOCK
+    virtual_timer_isr = isr;
+    virtual_timer_period_us = period_us;
+    virtual_next_tick_us = virtual_time_us + period_us;
+#else
+    struct sigevent event = { .sigev_notify = SIGEV_THREAD_ID, .sigev_signo = SIGALRM };
+    struct itimerspec period = {
+        .it_interval = { .tv_sec = period_us / 1000000, .tv_nsec = period_us % 1000000 * 1000 },
+        .it_value = { .tv_sec = period_us / 1000000, .tv_nsec = period_us % 1000000 * 1000 },
+    };
+    timer_t timer;
+    host_timer_isr = isr;
+    event._sigev_un._tid = gettid();
+    timer_create(CLOCK_MONOTONIC, &event, &timer);
+    timer_settime(timer, 0, &period, NULL);
+#endif
+}
+
+void port_timer_ack(void) {
+}
+
+// Either interrupt handler runs with both signals masked, like one interrupt level on the target
+void port_core_setup(void (*ipi_isr)(void)) {
+#ifndef RTOS_VIRTUAL_CLOCK
+    struct sigaction action = { .sa_flags = 0 };
+    sigemptyset(&action.sa_mask);
+    sigaddset(&action.sa_mask, SIGALRM);
+    sigaddset(&action.sa_mask, SIGUSR1);
+    action.sa_handler = host_timer_signal;
+    sigaction(SIGALRM, &action, NULL);
+    action.sa_handler = host_ipi_signal;
+    host_ipi_isr = ipi_isr;
+    sigaction(SIGUSR1, &action, NULL);
+    host_core_threads[port_core_id()] = pthread_self();
+    host_core_ready[port_core_id()] = true;
+#endif
+}
+
+void port_core_exit(void) {
+}
+
+void port_core_start(int core, void (*entry)(int)) {
+#ifndef RTOS_VIRTUAL_CLOCK
+    host_core_entry = entry;
+    pthread_create(&host_core_threads[core], NULL, host_core_thread, (void *)(intptr_t)core);
+#endif
+}
+
+void port_core_join(int core) {
+#ifndef RTOS_VIRTUAL_CLOCK
+    pthread_join(host_core_threads[core], NULL);
+#endif
+}
+
+void port_ipi_send(int core) {
+#ifndef RTOS_VIRTUAL_CLOCK
+    if (host_core_ready[core]) { // Before that the core has not started scheduling yet anyway
+        pthread_kill(host_core_threads[core], SIGUSR1);
+    }
+#endif
+}
+
+void port_context_init(port_context_t *context, uint8_t *stack, size_t size, void (*entry)(void)) {
+    getcontext(context);
+    context->uc_stack.ss_sp = stack;
+    context->uc_stack.ss_size = size;
+    context->uc_link = NULL;
+    sigemptyset(&context->uc_sigmask); // Tasks start with the timer "interrupt" enabled
+    makecontext(context, entry, 0);
+}
+
+// Callers hold interrupts disabled; port_irq_restore() performs the switch
+void port_context_switch(port_context_t *from, port_context_t *to) {
+    host_pending_from = from;
+    host_pending_to = to;
+}
+
+// Runs inside a signal handler; the preempted context later resumes (and returns) from here
+void port_context_switch_from_isr(port_context_t *from, port_context_t *to) {
+    swapcontext(from, to);
+}
+
+void port_wait_until(uint64_t deadline_us, volatile bool *wake) {
+#ifdef RTOS_VIRTUAL_CLOCK
+    if (!*wake && deadline_us > (uint64_t)virtual_time_us) {
+        virtual_time_us = deadline_us < RTOS_SIM_DURATION_US ? deadline_us : RTOS_SIM_DURATION_US;
+    }
+#else
+    port_irq_state_t irq = port_irq_disable();
+    while (!*wake) {
+        uint64_t now = esp_timer_get_time();
+        if (now >= deadline_us) break;
+        uint64_t wait_us = deadline_us - now < 100 * 1000 ? deadline_us - now : 100 * 1000;
+        struct timespec timeout = { .tv_sec = 0, .tv_nsec = wait_us * 1000 };
+        ppoll(NULL, 0, &timeout, &irq); // Unmasks the tick and IPI only while asleep, so neither is missed
+    }
+    port_irq_restore(irq);
+#endif
+    *wake = false;
+}
+
+bool port_running(void) {
+#ifdef RTOS_VIRTUAL_CLOCK
+    return (uint64_t)virtual_time_us < RTOS_SIM_DURATION_US;
+#else
+    return true;
+#endif
+}
+#endif
+
+// Task functions
+void producer_task(void *param) {
+    static int data = 0;
+    if (!queue_send(&task_queue, &data, 0)) { // Wakes the consumer
+        ESP_LOGW("Producer", "Queue full, dropped: %d", data);
+    } else {
+        ESP_LOGI("Producer", "Produced: %d", data);
+    }
+    data++;
+}
+
+// Released by the producer's queue_send() rather than by the clock: drains what has arrived
+void consumer_task(void *param) {
+    int data[16];
+    uint32_t count;
+
+    while ((count = queue_pop_n(&task_queue, data, 16)) > 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            ESP_LOGI("Consumer", "Consumed: %d", data[i]);
+        }
     }
-}
\ No newline at end of file
+}
+
+void critical_task(void *param) {
+    mutex_lock(&mutex);
+    ESP_LOGI("Critical", "In critical section");
+    task_delay_ms(500); // Other tasks run meanwhile
+    mutex_unlock(&mutex);
+}
+
+// Runs in the timer service task rather than a task slot of its own
+void heartbeat_callback(soft_timer_t *timer, void *arg) {
+    ESP_LOGI("Timer", "Heartbeat %u", (unsigned)timer->expiries);
+}
+
+co_status_t semaphore_task(coroutine_t *co, void *param) {
+    CO_BEGIN(co);
+    CO_AWAIT_SEMAPHORE(co, &semaphore);
+    ESP_LOGI("Semaphore", "Accessing shared resource");
+    CO_AWAIT_DELAY_MS(co, 500);
+    semaphore_signal(&semaphore);
+    CO_END(co);
+}
+
+// Main application
+void app_main(void) {
+    printf("Task scheduler example\n");
+    semaphore_init(&semaphore, 1);
+
+    // Set up the scheduler (choose the type here)
+    // scheduler_setup(SCHEDULER_PREEMPTIVE);
+    scheduler_setup(SCHEDULER_PRIORITY);
+    scheduler_set_admission_control(true);
+
+    // Add tasks with priorities and worst-case execution times. The critical and semaphore tasks
+    // sleep through their 500ms instead of busy-waiting, so they only need CPU time for the rest.
+    scheduler_add_task(producer_task, NULL, 1000, 2, 1000);
+    scheduler_add_task(consumer_task, NULL, 100, 1, 1000); // At most every 100 ms
+    scheduler_activate_on_queue(1, &task_queue);
+    scheduler_add_task(critical_task, NULL, 2000, 3, 1000);
+    scheduler_add_coroutine(semaphore_task, NULL, 2500, 4, 1000);
+    scheduler_add_timer_service(0, 0, 0);
+    soft_timer_create(&heartbeat_timer, 10000, true, heartbeat_callback, NULL);
+    soft_timer_start(&heartbeat_timer);
+
+    printf("Starting scheduler\n");
+
+    // Run the main loop on every core until scheduler_stop()
+    scheduler_start();
+    scheduler_log_stats();
+    mutex_stats_t stats = mutex_get_stats(&mutex);
+    ESP_LOGI("Mutex", "%u acquisitions, %u contended, %u spins, max hold %u us", (unsigned)stats.acquisitions,
+             (unsigned)stats.contended, (unsigned)stats.spins, (unsigned)stats.max_hold_us);
+}
+
+#ifndef ESP_PLATFORM
+int main(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    app_main();
+    return 0;
+}
+#endif
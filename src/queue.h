@@ -0,0 +1,118 @@
+// Queues of fixed-size items copied inline into caller-provided storage. Implemented in main.c;
+// this header is shared with C++ code through queue.hpp.
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef PORT_CACHE_LINE_SIZE
+#ifdef ESP_PLATFORM
+#define PORT_CACHE_LINE_SIZE 32
+#else
+#define PORT_CACHE_LINE_SIZE 64
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QUEUE_WAIT_FOREVER UINT32_MAX // Timeout for queue_send()/queue_receive() that never expires
+
+// Tasks blocked on a synchronization object, highest priority first (FIFO among equals), linked
+// through task_t.next_waiter. Links hold a task index + 1, so a zeroed wait list is empty.
+typedef struct {
+    int head;
+} wait_list_t;
+
+// Single-producer/single-consumer queue, lock-free between one producer and one consumer on any core
+// or in an ISR. head and tail are free-running counters masked by capacity - 1. Each sits on its own
+// cache line with that side's last view of the other counter, so most calls touch no shared line.
+typedef struct {
+    volatile uint32_t head __attribute__((aligned(PORT_CACHE_LINE_SIZE))); // Next item to pop; consumer only
+    uint32_t tail_seen;
+    volatile uint32_t tail __attribute__((aligned(PORT_CACHE_LINE_SIZE))); // Next slot to fill; producer only
+    uint32_t head_seen;
+    uint8_t *buffer __attribute__((aligned(PORT_CACHE_LINE_SIZE))); // capacity * item_size bytes
+    uint32_t item_size;
+    uint32_t capacity; // Power of two
+    volatile bool lock; // Guards the wait lists
+    volatile bool receiver_waiting; // Set while a task blocks (or is about to) in queue_receive()
+    volatile bool sender_waiting; // Same for queue_send()
+    wait_list_t receivers; // At most one task each, as there is one consumer and one producer
+    wait_list_t senders;
+    struct queue_set *set; // Queue set the consumer selects on (NULL = none)
+    int activates; // Consumer task activated by queue_send(), as index + 1 (0 = none)
+} queue_t;
+
+// Bounded multi-producer/multi-consumer queue (Vyukov): any number of ISRs and tasks on either core
+// on both sides. Each slot's sequence number says whose turn it is: pos when free for the push
+// that claims position pos, pos + 1 once it holds that item.
+typedef struct {
+    volatile uint32_t push_pos __attribute__((aligned(PORT_CACHE_LINE_SIZE)));
+    volatile uint32_t pop_pos __attribute__((aligned(PORT_CACHE_LINE_SIZE)));
+    uint8_t *slots __attribute__((aligned(PORT_CACHE_LINE_SIZE))); // Sequence number, then the item
+    uint32_t slot_size;
+    uint32_t item_offset;
+    uint32_t item_size;
+    uint32_t capacity; // Power of two, at least 2
+    volatile bool lock; // Guards the wait lists
+    volatile bool receiver_waiting; // Set while any task blocks (or is about to) in mpmc_queue_pop()
+    volatile bool sender_waiting; // Same for mpmc_queue_push()
+    wait_list_t receivers;
+    wait_list_t senders;
+} mpmc_queue_t;
+
+// The DEFINE macros below expand in C and C++ files alike. In both, members a designated initializer
+// leaves out are zeroed, but g++ -Wextra warns about them. Each macro ends in a static assertion, so
+// that the semicolon after it closes the declaration outside the pragmas.
+#ifdef __cplusplus
+#define QUEUE_STATIC_ASSERT static_assert
+#define QUEUE_INIT_BEGIN _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Wmissing-field-initializers\"")
+#define QUEUE_INIT_END _Pragma("GCC diagnostic pop")
+#else
+#define QUEUE_STATIC_ASSERT _Static_assert
+#define QUEUE_INIT_BEGIN
+#define QUEUE_INIT_END
+#endif
+
+// Define a queue of `count` items of `type` with static storage, ready to use
+#define QUEUE_DEFINE(name, type, count) \
+    static type name##_storage[count]; \
+    QUEUE_INIT_BEGIN \
+    queue_t name = { .buffer = (uint8_t *)name##_storage, .item_size = sizeof(type), .capacity = (count) }; \
+    QUEUE_INIT_END \
+    QUEUE_STATIC_ASSERT((count) > 0 && ((count) & ((count) - 1)) == 0, "Queue capacity must be a power of two")
+
+// Define an MPMC queue of `count` items of `type` with static storage; call mpmc_queue_init() on it
+#define MPMC_QUEUE_DEFINE(name, type, count) \
+    typedef struct { uint32_t sequence; type item; } name##_slot_t; \
+    static name##_slot_t name##_slots[count]; \
+    QUEUE_INIT_BEGIN \
+    mpmc_queue_t name = { .slots = (uint8_t *)name##_slots, .slot_size = sizeof(name##_slot_t), \
+                          .item_offset = offsetof(name##_slot_t, item), .item_size = sizeof(type), .capacity = (count) }; \
+    QUEUE_INIT_END \
+    QUEUE_STATIC_ASSERT((count) > 1 && ((count) & ((count) - 1)) == 0, "MPMC queue capacity must be a power of two")
+
+bool queue_init(queue_t *queue, void *buffer, uint32_t item_size, uint32_t capacity);
+bool queue_push(queue_t *queue, const void *item);
+bool queue_pop(queue_t *queue, void *item);
+uint32_t queue_push_n(queue_t *queue, const void *items, uint32_t n);
+uint32_t queue_pop_n(queue_t *queue, void *items, uint32_t n);
+uint32_t queue_count(queue_t *queue);
+bool queue_send(queue_t *queue, const void *item, uint32_t timeout_ms);
+bool queue_send_from_isr(queue_t *queue, const void *item, bool *woken);
+bool queue_receive(queue_t *queue, void *item, uint32_t timeout_ms);
+void mpmc_queue_init(mpmc_queue_t *queue);
+bool mpmc_queue_try_push(mpmc_queue_t *queue, const void *item);
+bool mpmc_queue_try_pop(mpmc_queue_t *queue, void *item);
+void mpmc_queue_push(mpmc_queue_t *queue, const void *item);
+void mpmc_queue_pop(mpmc_queue_t *queue, void *item);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+// C++ wrapper for queue_t with the capacity fixed at compile time and the storage inline:
+//     Queue<uint8_t, 64> samples; // 64 bytes of items
+//     samples.push(sample);
+#ifndef QUEUE_HPP
+#define QUEUE_HPP
+
+#include <type_traits>
+#include "queue.h"
+
+template <typename T, uint32_t N>
+class Queue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "Queue capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "Queue items are copied with memcpy");
+
+public:
+    Queue() {
+        queue_init(&queue_, storage_, sizeof(T), N);
+    }
+    Queue(const Queue &) = delete;
+    Queue &operator=(const Queue &) = delete;
+
+    // Producer side: false if the queue is full
+    bool push(const T &item) {
+        return queue_push(&queue_, &item);
+    }
+
+    // Producer side in an ISR: false if the queue is full. Wakes the consumer as queue_send() does and
+    // sets woken if it did; end the handler with scheduler_yield_from_isr() then.
+    bool push_from_isr(const T &item, bool &woken) {
+        return queue_send_from_isr(&queue_, &item, &woken);
+    }
+
+    // Consumer side: false if the queue is empty
+    bool pop(T &item) {
+        return queue_pop(&queue_, &item);
+    }
+
+    // Batches: as many of the n items as fit (or are there), moved with one publish. Return the count.
+    uint32_t push(const T *items, uint32_t n) {
+        return queue_push_n(&queue_, items, n);
+    }
+
+    uint32_t pop(T *items, uint32_t n) {
+        return queue_pop_n(&queue_, items, n);
+    }
+
+    uint32_t size() {
+        return queue_count(&queue_);
+    }
+
+    static constexpr uint32_t capacity() {
+        return N;
+    }
+
+    // The underlying queue, for the rest of the C API
+    queue_t *handle() {
+        return &queue_;
+    }
+
+private:
+    queue_t queue_;
+    T storage_[N];
+};
+
+#endif
@@ -0,0 +1,80 @@
+// Deadline miss rates of random periodic task sets under SCHEDULER_PRIORITY, SCHEDULER_PREEMPTIVE
+// (both with rate-monotonic priorities) and SCHEDULER_EDF, by total utilization. Each set runs for
+// ten seconds of simulated time in its own process, so every run starts from a fresh scheduler.
+#define RTOS_VIRTUAL_CLOCK
+#define RTOS_SIM_DURATION_US (10ULL * 1000000)
+#define MAX_TASKS 16
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "rtos_host.h"
+
+#define SETS 100
+#define SET_TASKS 6
+
+typedef struct {
+    uint32_t jobs;
+    uint32_t misses;
+} result_t;
+
+static uint32_t wcet_us[SET_TASKS];
+
+static void work(void *param) {
+    esp_rom_delay_us(*(uint32_t *)param);
+}
+
+// Periods of 10-200 ms; the utilization is split between the tasks by random weights
+static void run_set(scheduler_type_t type, unsigned seed, double utilization, result_t *result) {
+    uint32_t intervals_ms[SET_TASKS];
+    double weights[SET_TASKS], total = 0;
+
+    srand(seed);
+    for (int i = 0; i < SET_TASKS; i++) {
+        intervals_ms[i] = (rand() % 20 + 1) * 10;
+        weights[i] = rand() % 100 + 1;
+        total += weights[i];
+    }
+    scheduler_setup(type);
+    for (int i = 0; i < SET_TASKS; i++) {
+        int priority = 0; // Rate monotonic: shorter periods first
+        for (int j = 0; j < SET_TASKS; j++) {
+            if (intervals_ms[j] < intervals_ms[i] || (intervals_ms[j] == intervals_ms[i] && j < i)) priority++;
+        }
+        wcet_us[i] = (uint32_t)(weights[i] / total * utilization * intervals_ms[i] * 1000);
+        scheduler_add_task(work, &wcet_us[i], intervals_ms[i], priority, 0);
+    }
+    scheduler_start();
+    for (int i = 0; i < SET_TASKS; i++) {
+        result->jobs += task_list[i].jobs;
+        result->misses += task_list[i].deadline_misses;
+    }
+}
+
+int main(void) {
+    static const scheduler_type_t types[] = { SCHEDULER_PRIORITY, SCHEDULER_PREEMPTIVE, SCHEDULER_EDF };
+    static const double utilizations[] = { 0.6, 0.7, 0.8, 0.9, 0.95, 1.0 };
+    result_t *result = mmap(NULL, sizeof(result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    printf("%5s %24s %24s %24s\n", "U", "Priority (sets / jobs)", "Preemptive (sets / jobs)", "EDF (sets / jobs)");
+    for (int u = 0; u < (int)(sizeof(utilizations) / sizeof(utilizations[0])); u++) {
+        printf("%5.2f", utilizations[u]);
+        for (int t = 0; t < 3; t++) {
+            uint64_t jobs = 0, misses = 0;
+            int failed_sets = 0;
+            for (unsigned seed = 1; seed <= SETS; seed++) {
+                *result = (result_t){ 0 };
+                if (fork() == 0) {
+                    run_set(types[t], seed, utilizations[u], result);
+                    _exit(0);
+                }
+                wait(NULL);
+                jobs += result->jobs;
+                misses += result->misses;
+                failed_sets += result->misses > 0;
+            }
+            printf(" %14d%% / %5.2f%%", failed_sets * 100 / SETS, jobs ? misses * 100.0 / jobs : 0.0);
+        }
+        printf("\n");
+    }
+    return 0;
+}
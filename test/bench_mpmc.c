@@ -0,0 +1,137 @@
+// MPMC queue throughput and latency: 1, 2, 4 and 8 producer threads feed one consumer thread through
+// mpmc_queue_try_push()/try_pop(), against a 10-slot pointer FIFO under a pthread mutex. Latency is
+// from before the push to after the pop. Threads that find the queue full or empty yield, so with
+// fewer CPUs than threads the figures include the OS scheduler's turns.
+#include "rtos_host.h"
+#include <sched.h>
+#include <stdlib.h>
+
+#define MESSAGES 4000000u
+#define MAX_PRODUCERS 8
+#define FIFO_SIZE 10
+
+MPMC_QUEUE_DEFINE(small, uint64_t, 16);
+MPMC_QUEUE_DEFINE(large, uint64_t, 1024);
+
+typedef struct {
+    void *items[FIFO_SIZE];
+    int head;
+    int tail;
+    int size;
+    pthread_mutex_t lock;
+} locked_fifo_t;
+
+static locked_fifo_t fifo = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static mpmc_queue_t *shared; // NULL = the locked FIFO
+static uint32_t per_producer;
+static uint32_t latency[MESSAGES];
+static uint64_t pushed_sum[MAX_PRODUCERS], popped_sum;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool fifo_push(uint64_t item) {
+    bool pushed = false;
+
+    pthread_mutex_lock(&fifo.lock);
+    if (fifo.size < FIFO_SIZE) {
+        fifo.items[fifo.tail] = (void *)(uintptr_t)item;
+        fifo.tail = (fifo.tail + 1) % FIFO_SIZE;
+        fifo.size++;
+        pushed = true;
+    }
+    pthread_mutex_unlock(&fifo.lock);
+    return pushed;
+}
+
+static bool fifo_pop(uint64_t *item) {
+    bool popped = false;
+
+    pthread_mutex_lock(&fifo.lock);
+    if (fifo.size > 0) {
+        *item = (uintptr_t)fifo.items[fifo.head];
+        fifo.head = (fifo.head + 1) % FIFO_SIZE;
+        fifo.size--;
+        popped = true;
+    }
+    pthread_mutex_unlock(&fifo.lock);
+    return popped;
+}
+
+static void *producer(void *arg) {
+    int id = (int)(intptr_t)arg;
+
+    for (uint32_t i = 0; i < per_producer; i++) {
+        uint64_t stamp = now_ns();
+        while (!(shared ? mpmc_queue_try_push(shared, &stamp) : fifo_push(stamp))) sched_yield();
+        pushed_sum[id] += stamp;
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    uint32_t total = (uint32_t)(uintptr_t)arg;
+    uint64_t stamp;
+
+    for (uint32_t i = 0; i < total; i++) {
+        while (!(shared ? mpmc_queue_try_pop(shared, &stamp) : fifo_pop(&stamp))) sched_yield();
+        latency[i] = (uint32_t)(now_ns() - stamp);
+        popped_sum += stamp;
+    }
+    return NULL;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Returns false if an item was lost or delivered twice
+static bool run(const char *name, mpmc_queue_t *queue, int producers) {
+    pthread_t threads[MAX_PRODUCERS + 1];
+    uint32_t total = MESSAGES / producers * producers;
+    uint64_t pushed = 0;
+
+    if (queue != NULL) mpmc_queue_init(queue);
+    shared = queue;
+    per_producer = MESSAGES / producers;
+    popped_sum = 0;
+    uint64_t start = now_ns();
+    pthread_create(&threads[0], NULL, consumer, (void *)(uintptr_t)total);
+    for (int p = 0; p < producers; p++) {
+        pushed_sum[p] = 0;
+        pthread_create(&threads[p + 1], NULL, producer, (void *)(intptr_t)p);
+    }
+    for (int p = 0; p <= producers; p++) {
+        pthread_join(threads[p], NULL);
+    }
+    double seconds = (now_ns() - start) * 1e-9;
+    for (int p = 0; p < producers; p++) {
+        pushed += pushed_sum[p];
+    }
+
+    qsort(latency, total, sizeof(latency[0]), compare_u32);
+    printf("%-16s %9d %9.2f M msgs/s %9.1f us %9.1f us\n", name, producers, total / seconds * 1e-6,
+           latency[total / 2] * 1e-3, latency[(uint64_t)total * 99 / 100] * 1e-3);
+    return pushed == popped_sum;
+}
+
+int main(void) {
+    bool intact = true;
+
+    printf("%-16s %9s %17s %12s %12s\n", "Queue", "Producers", "Throughput", "p50", "p99");
+    for (int producers = 1; producers <= MAX_PRODUCERS; producers *= 2) {
+        intact &= run("MPMC, 16 slots", &small, producers);
+    }
+    for (int producers = 1; producers <= MAX_PRODUCERS; producers *= 2) {
+        intact &= run("MPMC, 1024 slots", &large, producers);
+    }
+    for (int producers = 1; producers <= MAX_PRODUCERS; producers *= 2) {
+        intact &= run("Locked FIFO", NULL, producers);
+    }
+    printf("%s\n", intact ? "Every item delivered once" : "Items lost or duplicated");
+    return 0;
+}
@@ -0,0 +1,64 @@
+// The inversion scenario of bench_priority_inversion with one mutex, under priority inheritance and under
+// an immediate ceiling of 1 (the high-priority task's priority). Reports how often the high-priority
+// task found the mutex taken when it woke, and how long after waking it got it.
+#define RTOS_VIRTUAL_CLOCK
+#define RTOS_SIM_DURATION_US (4ULL * 1000000)
+#include "rtos_host.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+typedef struct {
+    uint64_t wait_max;
+    uint32_t taken;
+    uint32_t jobs;
+} result_t;
+
+static mutex_t bus;
+static result_t *result;
+
+static void low(void *param) {
+    mutex_lock(&bus);
+    esp_rom_delay_us(5000);
+    mutex_unlock(&bus);
+}
+
+static void high(void *param) {
+    uint64_t wake = esp_timer_get_time() + 2000;
+
+    task_delay_until(wake);
+    if (!mutex_try_lock(&bus)) {
+        result->taken++;
+        mutex_lock(&bus);
+    }
+    uint64_t waited = esp_timer_get_time() - wake;
+    mutex_unlock(&bus);
+    result->jobs++;
+    if (waited > result->wait_max) result->wait_max = waited;
+}
+
+static void medium(void *param) {
+    task_delay_ms(3);
+    esp_rom_delay_us(30000);
+}
+
+int main(void) {
+    result = mmap(NULL, sizeof(result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    printf("%-12s %12s %10s\n", "Mutex", "Found taken", "Max wait");
+    for (int ceiling = 0; ceiling <= 1; ceiling++) {
+        *result = (result_t){ 0 };
+        if (fork() == 0) {
+            if (ceiling) mutex_init_ceiling(&bus, 1);
+            scheduler_setup(SCHEDULER_PREEMPTIVE);
+            scheduler_add_task(low, NULL, 100, 10, 0);
+            scheduler_add_task(high, NULL, 100, 1, 0);
+            scheduler_add_task(medium, NULL, 100, 5, 0);
+            scheduler_start();
+            _exit(0);
+        }
+        wait(NULL);
+        printf("%-12s %6u of %2u %7llu us\n", ceiling ? "Ceiling 1" : "Inheritance", (unsigned)result->taken,
+               (unsigned)result->jobs, (unsigned long long)result->wait_max);
+    }
+    return 0;
+}
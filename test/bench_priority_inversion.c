@@ -0,0 +1,107 @@
+// Priority inversion on one core in preemptive mode, over four seconds of simulated time. Every 100 ms a
+// low-priority task takes a lock for 5 ms; 2 ms later a high-priority task wants it, and 1 ms after that
+// a medium-priority task starts 30 ms of work. Reports how long the high-priority task waited for the
+// lock, with a mutex (priority inheritance) against a binary semaphore (none). In the chained variant
+// the high-priority task wants a second lock, held by a task that is itself waiting for the first.
+#define RTOS_VIRTUAL_CLOCK
+#define RTOS_SIM_DURATION_US (4ULL * 1000000)
+#include "rtos_host.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+typedef struct {
+    uint64_t wait_sum;
+    uint64_t wait_max;
+    uint32_t jobs;
+} result_t;
+
+static bool use_mutex;
+static mutex_t mutexes[2];
+static semaphore_t semaphores[2];
+static result_t *result;
+
+static void lock(int which) {
+    if (use_mutex) {
+        mutex_lock(&mutexes[which]);
+    } else {
+        semaphore_wait(&semaphores[which]);
+    }
+}
+
+static void unlock(int which) {
+    if (use_mutex) {
+        mutex_unlock(&mutexes[which]);
+    } else {
+        semaphore_signal(&semaphores[which]);
+    }
+}
+
+static void low(void *param) {
+    lock(0);
+    esp_rom_delay_us(5000);
+    unlock(0);
+}
+
+// Chained variant: takes the second lock, then waits for the first
+static void middle(void *param) {
+    task_delay_ms(1);
+    lock(1);
+    lock(0);
+    esp_rom_delay_us(1000);
+    unlock(0);
+    unlock(1);
+}
+
+static void high(void *param) {
+    int which = (int)(intptr_t)param;
+
+    task_delay_ms(2);
+    uint64_t start = esp_timer_get_time();
+    lock(which);
+    uint64_t waited = esp_timer_get_time() - start;
+    unlock(which);
+    result->wait_sum += waited;
+    result->jobs++;
+    if (waited > result->wait_max) result->wait_max = waited;
+}
+
+static void medium(void *param) {
+    task_delay_ms(3);
+    esp_rom_delay_us(30000);
+}
+
+static void run(bool mutex, bool chained) {
+    use_mutex = mutex;
+    for (int i = 0; i < 2; i++) {
+        semaphore_init(&semaphores[i], 1); // The mutexes start unlocked, zero-initialized
+    }
+    scheduler_setup(SCHEDULER_PREEMPTIVE);
+    scheduler_add_task(low, NULL, 100, 10, 0);
+    scheduler_add_task(high, (void *)(intptr_t)chained, 100, 1, 0);
+    scheduler_add_task(medium, NULL, 100, 5, 0);
+    if (chained) {
+        scheduler_add_task(middle, NULL, 100, 6, 0);
+    }
+    scheduler_start();
+}
+
+int main(void) {
+    result = mmap(NULL, sizeof(result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    printf("%-10s %-18s %10s %10s %6s\n", "", "Lock", "Avg wait", "Max wait", "Jobs");
+    for (int chained = 0; chained <= 1; chained++) {
+        for (int mutex = 1; mutex >= 0; mutex--) {
+            *result = (result_t){ 0 };
+            if (fork() == 0) {
+                run(mutex, chained);
+                _exit(0);
+            }
+            wait(NULL);
+            printf("%-10s %-18s %7llu us %7llu us %6u\n", chained ? "Chained" : "Direct",
+                   mutex ? "Mutex (inherits)" : "Semaphore (no)",
+                   (unsigned long long)(result->jobs ? result->wait_sum / result->jobs : 0),
+                   (unsigned long long)result->wait_max, (unsigned)result->jobs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+// SPSC queue cost: push+pop pairs on one thread, then throughput between a producer and a consumer thread,
+// against the queue it replaced (a 10-slot pointer FIFO, here under a pthread mutex). Two-thread figures
+// depend on whether the threads have a CPU each: sharing one, they take turns.
+#include "rtos_host.h"
+#include <sched.h>
+
+#define PAIRS 20000000u
+#define MESSAGES 20000000u
+#define FIFO_SIZE 10
+
+QUEUE_DEFINE(words, uint32_t, 1024);
+QUEUE_DEFINE(bytes, uint8_t, 1024);
+QUEUE_DEFINE(small, uint32_t, 16);
+
+typedef struct {
+    void *items[FIFO_SIZE];
+    int head;
+    int tail;
+    int size;
+    pthread_mutex_t lock;
+} locked_fifo_t;
+
+static locked_fifo_t fifo = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static queue_t *shared;
+static volatile uint32_t out_of_order;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static bool fifo_push(void *item) {
+    bool pushed = false;
+
+    pthread_mutex_lock(&fifo.lock);
+    if (fifo.size < FIFO_SIZE) {
+        fifo.items[fifo.tail] = item;
+        fifo.tail = (fifo.tail + 1) % FIFO_SIZE;
+        fifo.size++;
+        pushed = true;
+    }
+    pthread_mutex_unlock(&fifo.lock);
+    return pushed;
+}
+
+static bool fifo_pop(void **item) {
+    bool popped = false;
+
+    pthread_mutex_lock(&fifo.lock);
+    if (fifo.size > 0) {
+        *item = fifo.items[fifo.head];
+        fifo.head = (fifo.head + 1) % FIFO_SIZE;
+        fifo.size--;
+        popped = true;
+    }
+    pthread_mutex_unlock(&fifo.lock);
+    return popped;
+}
+
+static void *queue_producer(void *arg) {
+    for (uint32_t i = 1; i <= MESSAGES; i++) {
+        while (!queue_push(shared, &i)) sched_yield();
+    }
+    return NULL;
+}
+
+static void *queue_consumer(void *arg) {
+    uint32_t item;
+    for (uint32_t i = 1; i <= MESSAGES; i++) {
+        while (!queue_pop(shared, &item)) sched_yield();
+        if (item != i) out_of_order++;
+    }
+    return NULL;
+}
+
+static void *fifo_producer(void *arg) {
+    for (uintptr_t i = 1; i <= MESSAGES; i++) {
+        while (!fifo_push((void *)i)) sched_yield();
+    }
+    return NULL;
+}
+
+static void *fifo_consumer(void *arg) {
+    void *item;
+    for (uintptr_t i = 1; i <= MESSAGES; i++) {
+        while (!fifo_pop(&item)) sched_yield();
+        if ((uintptr_t)item != i) out_of_order++;
+    }
+    return NULL;
+}
+
+static void run_threads(const char *name, void *(*producer)(void *), void *(*consumer)(void *)) {
+    pthread_t threads[2];
+    double start = now_ns();
+
+    pthread_create(&threads[0], NULL, producer, NULL);
+    pthread_create(&threads[1], NULL, consumer, NULL);
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    printf("%-34s %6.1f M msgs/s\n", name, MESSAGES / (now_ns() - start) * 1e3);
+}
+
+int main(void) {
+    uint32_t word;
+    uint8_t byte;
+    void *pointer;
+
+    double start = now_ns();
+    for (uint32_t i = 0; i < PAIRS; i++) {
+        queue_push(&words, &i);
+        queue_pop(&words, &word);
+    }
+    printf("%-34s %6.1f ns\n", "One thread, uint32_t push+pop", (now_ns() - start) / PAIRS);
+
+    start = now_ns();
+    for (uint32_t i = 0; i < PAIRS; i++) {
+        byte = (uint8_t)i;
+        queue_push(&bytes, &byte);
+        queue_pop(&bytes, &byte);
+    }
+    printf("%-34s %6.1f ns\n", "One thread, uint8_t push+pop", (now_ns() - start) / PAIRS);
+
+    start = now_ns();
+    for (uintptr_t i = 0; i < PAIRS; i++) {
+        fifo_push((void *)i);
+        fifo_pop(&pointer);
+    }
+    printf("%-34s %6.1f ns\n", "One thread, locked FIFO push+pop", (now_ns() - start) / PAIRS);
+
+    shared = &words;
+    run_threads("Two threads, 1024 slots", queue_producer, queue_consumer);
+    shared = &small;
+    run_threads("Two threads, 16 slots", queue_producer, queue_consumer);
+    run_threads("Two threads, locked FIFO", fifo_producer, fifo_consumer);
+    printf("%u items out of order\n", (unsigned)out_of_order);
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Cost per item of moving uint32_t items through a 1024-slot queue in batches of 1, 8 and 64 with
+// queue_push_n()/queue_pop_n(): push+pop on one thread, then a producer thread and a consumer thread,
+// against single queue_push()/queue_pop() calls.
+#include "rtos_host.h"
+#include <sched.h>
+
+#define ITEMS 64000000u
+#define MAX_BATCH 64
+
+QUEUE_DEFINE(items, uint32_t, 1024);
+
+static uint32_t batch;
+static volatile uint32_t out_of_order;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *producer(void *arg) {
+    uint32_t buffer[MAX_BATCH];
+
+    for (uint32_t next = 0; next < ITEMS; next += batch) {
+        for (uint32_t i = 0; i < batch; i++) {
+            buffer[i] = next + i;
+        }
+        for (uint32_t done = 0; done < batch;) {
+            uint32_t pushed = queue_push_n(&items, buffer + done, batch - done);
+            if (pushed == 0) sched_yield();
+            done += pushed;
+        }
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    uint32_t buffer[MAX_BATCH];
+
+    for (uint32_t expected = 0; expected < ITEMS;) {
+        uint32_t popped = queue_pop_n(&items, buffer, batch);
+        if (popped == 0) sched_yield();
+        for (uint32_t i = 0; i < popped; i++) {
+            if (buffer[i] != expected++) out_of_order++;
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    uint32_t buffer[MAX_BATCH] = { 0 }, item;
+
+    double start = now_ns();
+    for (uint32_t i = 0; i < ITEMS; i++) {
+        queue_push(&items, &i);
+        queue_pop(&items, &item);
+    }
+    printf("%-10s %16s %24s\n", "Batch", "One thread", "Two threads");
+    printf("%-10s %13.2f ns %24s\n", "Single", (now_ns() - start) / ITEMS, "-");
+
+    for (batch = 1; batch <= MAX_BATCH; batch *= 8) {
+        start = now_ns();
+        for (uint32_t i = 0; i < ITEMS; i += batch) {
+            queue_push_n(&items, buffer, batch);
+            queue_pop_n(&items, buffer, batch);
+        }
+        double one_thread = (now_ns() - start) / ITEMS;
+
+        pthread_t threads[2];
+        start = now_ns();
+        pthread_create(&threads[0], NULL, producer, NULL);
+        pthread_create(&threads[1], NULL, consumer, NULL);
+        pthread_join(threads[0], NULL);
+        pthread_join(threads[1], NULL);
+        double two_threads = (now_ns() - start) / ITEMS;
+        printf("%-10u %13.2f ns %9.2f ns (%5.1f M items/s)\n", batch, one_thread, two_threads, 1e3 / two_threads);
+    }
+    printf("%u items out of order\n", (unsigned)out_of_order);
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Cost of picking the next task against the task count: the ready bitmap and per-priority lists,
+// against the linear scan of task_list they replaced. Each round dispatches the highest ready task
+// and makes it ready again, as a job does.
+#define MAX_TASKS 1024
+#include "rtos_host.h"
+
+#define ROUNDS 4000000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The old selection: the ready task with the lowest priority value, the first in the table among equals
+static int scan_highest(int count) {
+    int best = -1;
+
+    for (int i = 0; i < count; i++) {
+        if (task_list[i].state == TASK_READY && (best == -1 || task_list[i].priority < task_list[best].priority)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+int main(void) {
+    core_t *core = &cores[0];
+    volatile int sink = 0;
+
+    scheduler_setup(SCHEDULER_PRIORITY);
+    printf("%6s %12s %12s\n", "Tasks", "Bitmap", "Scan");
+    for (int n = 4; n <= MAX_TASKS; n *= 4) {
+        for (int i = 0; i < n; i++) {
+            task_list[i].priority = i % MAX_PRIORITIES;
+            task_list[i].state = TASK_READY;
+            ready_list_push(core, i);
+        }
+
+        double start = now_ns();
+        for (int round = 0; round < ROUNDS; round++) {
+            int index = ready_list_highest(core);
+            ready_list_remove(core, index);
+            ready_list_push(core, index);
+            sink += index;
+        }
+        double bitmap = (now_ns() - start) / ROUNDS;
+
+        int scan_rounds = ROUNDS / n;
+        start = now_ns();
+        for (int round = 0; round < scan_rounds; round++) {
+            sink += scan_highest(n);
+        }
+        double scan = (now_ns() - start) / scan_rounds;
+
+        printf("%6d %9.1f ns %9.1f ns\n", n, bitmap, scan);
+        for (int i = 0; i < n; i++) {
+            ready_list_remove(core, i);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Release jitter of the demo's periodic tasks over an hour of simulated time, with the main loop waiting
+// for the next release against the old loop that ran the scheduler and then slept a fixed 100 ms.
+// Usage: bench_release_jitter [poll_ms]; without poll_ms the loop waits for the next release.
+#define RTOS_VIRTUAL_CLOCK
+#include <stdlib.h>
+#include "rtos_host.h"
+
+static const uint32_t intervals_ms[] = { 1000, 1500, 250, 700 };
+#define TASKS (int)(sizeof(intervals_ms) / sizeof(intervals_ms[0]))
+
+static uint64_t jitter_sum[TASKS];
+
+static void work(void *param) {
+    int index = cores[0].current_task;
+
+    jitter_sum[index] += esp_timer_get_time() - task_list[index].next_release;
+    esp_rom_delay_us(2000);
+}
+
+// The loop this repo started with: no wakeup time, a fixed sleep after every pass
+static void run_polling(uint32_t poll_us) {
+    scheduler_running = true;
+    scheduler_start_time = esp_timer_get_time();
+    port_core_setup(scheduler_ipi_isr);
+    while (port_running()) {
+        scheduler_run();
+        esp_rom_delay_us(poll_us);
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t poll_ms = argc > 1 ? atoi(argv[1]) : 0;
+
+    scheduler_setup(SCHEDULER_PRIORITY);
+    for (int i = 0; i < TASKS; i++) {
+        scheduler_add_task(work, NULL, intervals_ms[i], i, 0);
+    }
+    if (poll_ms > 0) {
+        run_polling(poll_ms * 1000);
+    } else {
+        scheduler_start();
+    }
+
+    printf("%s\n%6s %10s %10s %12s %12s\n", poll_ms > 0 ? "Fixed sleep" : "Wait for next release", "Task",
+           "Period", "Jobs", "Avg jitter", "Max jitter");
+    for (int i = 0; i < TASKS; i++) {
+        printf("%6d %7u ms %10u %9llu us %9llu us\n", i, (unsigned)intervals_ms[i], (unsigned)task_list[i].jobs,
+               (unsigned long long)(jitter_sum[i] / (task_list[i].jobs ? task_list[i].jobs : 1)),
+               (unsigned long long)task_list[i].max_jitter_us);
+    }
+    return 0;
+}
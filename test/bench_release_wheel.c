@@ -0,0 +1,99 @@
+// Cost per release against the number of waiting tasks: the release wheel and the release heap that
+// RELEASE_WHEEL chooses between, against a linear scan of all tasks. Every task has a random period
+// of 1 ms to 1 s and a random first release; each round releases the earliest one and queues its
+// next release, as the main loop does. The entries stand in for tasks, so MAX_TASKS is raised only to
+// size the heap. Build with -DWHEEL_TICK_SHIFT=10 to see the cost of 1 ms slots.
+#define MAX_ENTRIES 100000
+#define MAX_TASKS MAX_ENTRIES
+#define MAX_STACKS 1
+#include "rtos_host.h"
+#include <stdlib.h>
+
+#define ROUNDS 4000000
+
+typedef struct {
+    wheel_entry_t wheel;
+    uint64_t period;
+} entry_t;
+
+static entry_t entries[MAX_ENTRIES];
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Random periods and first releases, the same for every structure
+static void reset_entries(int n) {
+    srand(n);
+    for (int i = 0; i < n; i++) {
+        entries[i].period = 1000 + rand() % 999001;
+        entries[i].wheel.time = rand() % entries[i].period;
+    }
+}
+
+static double bench_wheel(int n) {
+    static release_wheel_t wheel;
+
+    reset_entries(n);
+    release_wheel_init(&wheel);
+    for (int i = 0; i < n; i++) {
+        release_wheel_push(&wheel, &entries[i].wheel);
+    }
+    double start = now_ns();
+    for (int round = 0; round < ROUNDS; round++) {
+        wheel_entry_t *due;
+        uint64_t now = release_wheel_next_time(&wheel);
+        while ((due = release_wheel_expire(&wheel, now)) == NULL) {
+            now = release_wheel_next_time(&wheel); // Cascaded: now exact
+        }
+        due->time += ((entry_t *)due)->period;
+        release_wheel_push(&wheel, due);
+    }
+    return (now_ns() - start) / ROUNDS;
+}
+
+static double bench_heap(int n) {
+    static release_heap_t heap;
+
+    reset_entries(n);
+    release_heap_init(&heap);
+    for (int i = 0; i < n; i++) {
+        release_heap_push(&heap, &entries[i].wheel);
+    }
+    double start = now_ns();
+    for (int round = 0; round < ROUNDS; round++) {
+        wheel_entry_t *due = release_heap_expire(&heap, release_heap_next_time(&heap));
+        due->time += ((entry_t *)due)->period;
+        release_heap_push(&heap, due);
+    }
+    return (now_ns() - start) / ROUNDS;
+}
+
+static double bench_scan(int n) {
+    int rounds = ROUNDS / n + 1;
+
+    reset_entries(n);
+    double start = now_ns();
+    for (int round = 0; round < rounds; round++) {
+        int due = 0;
+        for (int i = 1; i < n; i++) {
+            if (entries[i].wheel.time < entries[due].wheel.time) due = i;
+        }
+        entries[due].wheel.time += entries[due].period;
+    }
+    return (now_ns() - start) / rounds;
+}
+
+int main(void) {
+    printf("Level-0 slots of %d us\n", 1 << WHEEL_TICK_SHIFT);
+    printf("%7s %12s %12s %14s\n", "Tasks", "Wheel", "Heap", "Scan");
+    for (int n = 10; n <= MAX_ENTRIES; n *= 10) {
+        double wheel = bench_wheel(n);
+        double heap_ns = bench_heap(n);
+        double scan = bench_scan(n);
+        printf("%7d %9.0f ns %9.0f ns %11.0f ns\n", n, wheel, heap_ns, scan);
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+// Throughput against the number of cores: sixteen CPU-bound tasks that always have a job due, run for
+// two seconds of wall time. Built once per core count (bench_smp_scaling_1, bench_smp_scaling,
+// bench_smp_scaling_4); each core is a thread, so it only scales with as many idle host CPUs, and the
+// benchmark refuses to run with fewer online CPUs than cores.
+#define MAX_TASKS 17
+#include "rtos_host.h"
+
+#define WORKERS (MAX_TASKS - 1)
+#define JOB_US 200
+
+static void work(void *param) {
+    esp_rom_delay_us(JOB_US);
+}
+
+static void stopper(void *param) {
+    static int runs;
+    if (++runs == 2) scheduler_stop();
+}
+
+int main(void) {
+    uint32_t jobs = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpus > 0 && cpus < NUM_CORES) {
+        fprintf(stderr, "bench_smp_scaling: %ld host CPU(s) for %d cores, no result\n", cpus, NUM_CORES);
+        return 1;
+    }
+    scheduler_setup(SCHEDULER_PRIORITY);
+    for (int i = 0; i < WORKERS; i++) {
+        scheduler_add_task(work, NULL, 1, 1 + i % 3, 0);
+    }
+    scheduler_add_task(stopper, NULL, 1000, 0, 0);
+    scheduler_start();
+
+    for (int c = 0; c < NUM_CORES; c++) {
+        jobs += cores[c].jobs;
+    }
+    printf("%d cores: %u jobs/s (%u per core)\n", NUM_CORES, (unsigned)(jobs / 2), (unsigned)(jobs / 2 / NUM_CORES));
+    return 0;
+}
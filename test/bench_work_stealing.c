@@ -0,0 +1,75 @@
+// An imbalanced load: four tasks pinned to core 0 need 160% of it, while core 1 has nothing to do. Runs
+// two seconds of wall time without and then with work stealing, each in its own process, and reports
+// the jobs run, the missed deadlines and how busy each core was. The cores are host threads, so the
+// result only means something with a host CPU per core: the benchmark refuses to run with fewer, and
+// fails if stealing did not run more jobs with fewer misses.
+#include "rtos_host.h"
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define HEAVY_TASKS 4
+
+typedef struct {
+    uint32_t jobs;
+    uint32_t misses;
+    uint32_t steals;
+} result_t;
+
+static void heavy(void *param) {
+    esp_rom_delay_us(4000);
+}
+
+static void stopper(void *param) {
+    static int runs;
+    if (++runs == 3) scheduler_stop();
+}
+
+static void run(bool stealing, result_t *result) {
+    scheduler_setup(SCHEDULER_PRIORITY);
+    scheduler_set_work_stealing(stealing);
+    for (int i = 0; i < HEAVY_TASKS; i++) {
+        scheduler_add_task(heavy, NULL, 10, 1 + i, 0);
+        scheduler_set_affinity(i, 0);
+        scheduler_set_migration(i, MIGRATE_JOBS);
+    }
+    scheduler_add_task(stopper, NULL, 1000, 0, 0);
+    scheduler_start();
+
+    uint64_t elapsed_us = esp_timer_get_time() - scheduler_start_time;
+    for (int i = 0; i < HEAVY_TASKS; i++) {
+        result->jobs += task_list[i].jobs;
+        result->misses += task_list[i].deadline_misses;
+    }
+    result->steals = cores[1].steals;
+    printf("%-12s %6u %8u", stealing ? "Stealing" : "No stealing", (unsigned)result->jobs, (unsigned)result->misses);
+    for (int c = 0; c < NUM_CORES; c++) {
+        printf(" %5u%%", (unsigned)(100 - cores[c].idle_us * 100 / elapsed_us));
+    }
+    printf(" %7u\n", (unsigned)result->steals);
+}
+
+int main(void) {
+    cpu_set_t cpus;
+    result_t *results = mmap(NULL, 2 * sizeof(result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0 && CPU_COUNT(&cpus) < NUM_CORES) {
+        fprintf(stderr, "bench_work_stealing: %d host CPU(s) for %d cores, no result\n", CPU_COUNT(&cpus), NUM_CORES);
+        return 1;
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("%-12s %6s %8s %6s %6s %7s\n", "", "Jobs", "Missed", "Core 0", "Core 1", "Stolen");
+    for (int stealing = 0; stealing <= 1; stealing++) {
+        results[stealing] = (result_t){ 0 };
+        if (fork() == 0) {
+            run(stealing, &results[stealing]);
+            _exit(0);
+        }
+        wait(NULL);
+    }
+    if (results[1].steals == 0 || results[1].jobs <= results[0].jobs || results[1].misses >= results[0].misses) {
+        fprintf(stderr, "bench_work_stealing: no gain from stealing measured\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,18 @@
+// Included by every test and benchmark after its configuration defines: the whole scheduler, with its
+// host main() renamed so the includer can provide its own and reach the internals
+#define main rtos_main
+#include "../src/main.c"
+#undef main
+
+static int check_failures __attribute__((unused));
+
+// Report a failed expectation and carry on; a test returns check_failures != 0 from main()
+#define CHECK(cond, ...)                                           \
+    do {                                                           \
+        if (!(cond)) {                                             \
+            printf("%s:%d: check failed: ", __FILE__, __LINE__);   \
+            printf(__VA_ARGS__);                                   \
+            printf("\n");                                          \
+            check_failures++;                                      \
+        }                                                          \
+    } while (0)
@@ -0,0 +1,82 @@
+// Event-triggered tasks on the host clock, one core, preemptive mode. A source task fires every 1 ms:
+// it sets an event bit, sends one item and gives a semaphore. The task bound to the bit runs within
+// a fraction of a tick of each set, the task bound to the queue runs once per item, and the task
+// bound to the semaphore, with a 5 ms minimum interval, is released exactly every 5 ms.
+#include "rtos_host.h"
+
+#define FIRES 3000
+#define MIN_INTERVAL_MS 5
+#define EVENT_BIT (1u << 0)
+
+QUEUE_DEFINE(items, uint32_t, 8);
+static semaphore_t ticks;
+static event_group_t events;
+
+static int fires, event_runs, queue_runs, queue_items, semaphore_runs, semaphore_takes;
+static uint64_t set_at, latency_sum, latency_max;
+static int sem_bound;
+static uint64_t last_release, short_gaps;
+
+static void source(void *param) {
+    uint32_t item = fires;
+
+    set_at = esp_timer_get_time();
+    event_group_set(&events, EVENT_BIT); // The bound task preempts this one here
+    queue_send(&items, &item, 0);
+    semaphore_signal(&ticks);
+    if (++fires == FIRES) scheduler_stop();
+}
+
+static void on_event(void *param) {
+    uint64_t latency = esp_timer_get_time() - set_at;
+    latency_sum += latency;
+    if (latency > latency_max) latency_max = latency;
+    event_runs++;
+    event_group_clear(&events, EVENT_BIT);
+}
+
+static void on_queue(void *param) {
+    uint32_t item;
+    queue_runs++;
+    while (queue_pop(&items, &item)) queue_items++; // Drain: activations meanwhile add at most one job
+}
+
+static void on_semaphore(void *param) {
+    uint64_t release = task_list[sem_bound].next_release;
+    if (semaphore_runs > 0 && release - last_release < MIN_INTERVAL_MS * 1000) short_gaps++;
+    last_release = release;
+    semaphore_runs++;
+    while (semaphore_try_wait(&ticks)) semaphore_takes++;
+}
+
+int main(void) {
+    semaphore_init(&ticks, 0);
+    scheduler_setup(SCHEDULER_PREEMPTIVE);
+    scheduler_add_task(source, NULL, 1, 3, 0);
+    scheduler_add_task(on_event, NULL, 0, 0, 0);
+    scheduler_add_task(on_queue, NULL, 0, 1, 0);
+    sem_bound = task_count;
+    scheduler_add_task(on_semaphore, NULL, MIN_INTERVAL_MS, 2, 0);
+    scheduler_activate_on_event(1, &events, EVENT_BIT);
+    scheduler_activate_on_queue(2, &items);
+    scheduler_activate_on_semaphore(sem_bound, &ticks);
+    for (int i = 0; i < task_count; i++) {
+        scheduler_set_affinity(i, 0);
+    }
+    scheduler_start();
+
+    uint64_t average = event_runs ? latency_sum / event_runs : 0;
+    printf("%d fires: event-bound task ran %d times, %llu us average and %llu us max after the set\n", fires,
+           event_runs, (unsigned long long)average, (unsigned long long)latency_max);
+    printf("Queue-bound task: %d runs for %d items. Semaphore-bound task: %d runs for %d gives\n", queue_runs,
+           queue_items, semaphore_runs, semaphore_takes);
+    CHECK(event_runs == fires, "%d runs for %d sets", event_runs, fires);
+    CHECK(average < TICK_PERIOD_US / 4, "%llu us average latency: the bound task waited for a tick",
+          (unsigned long long)average);
+    CHECK(queue_items >= fires - 1 && queue_runs == queue_items, "%d runs for %d of %d items", queue_runs,
+          queue_items, fires);
+    CHECK(short_gaps == 0, "%llu releases sooner than %d ms apart", (unsigned long long)short_gaps, MIN_INTERVAL_MS);
+    CHECK(semaphore_runs >= fires / MIN_INTERVAL_MS - 2 && semaphore_takes >= fires - 2 * MIN_INTERVAL_MS,
+          "%d runs taking %d of %d gives", semaphore_runs, semaphore_takes, fires);
+    return check_failures != 0;
+}
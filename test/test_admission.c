@@ -0,0 +1,77 @@
+// Admission control accepts the task sets each scheduler type can run without misses and rejects the
+// rest. Every case is checked on its own, on one core.
+#define NUM_CORES 1
+#include "rtos_host.h"
+
+typedef struct {
+    uint32_t wcet_ms;
+    uint32_t interval_ms;
+    int priority;
+} spec_t;
+
+static void work(void *param) {
+}
+
+// Add the tasks in order; the result of adding the last one
+static admit_result_t admit(scheduler_type_t type, const spec_t *specs, int count) {
+    admit_result_t result = ADMIT_OK;
+
+    task_count = 0;
+    stack_count = 0;
+    critical_section_count = 0;
+    scheduler_setup(type);
+    scheduler_set_admission_control(true);
+    for (int i = 0; i < count && result == ADMIT_OK; i++) {
+        result = scheduler_add_task(work, NULL, specs[i].interval_ms, specs[i].priority, specs[i].wcet_ms * 1000);
+    }
+    return result;
+}
+
+#define ADMIT(type, ...) admit(type, (const spec_t[]){ __VA_ARGS__ }, sizeof((const spec_t[]){ __VA_ARGS__ }) / sizeof(spec_t))
+
+int main(void) {
+    // A task is not blocked by its own job: non-preemptive blocking comes from lower priorities only
+    CHECK(ADMIT(SCHEDULER_PRIORITY, { 6, 10, 0 }) == ADMIT_OK, "(6, 10) rejected");
+    CHECK(ADMIT(SCHEDULER_PRIORITY, { 1, 10, 0 }, { 8, 10, 1 }) == ADMIT_OK, "(1, 10), (8, 10) rejected");
+    CHECK(ADMIT(SCHEDULER_PRIORITY, { 8, 10, 0 }, { 1, 10, 1 }) == ADMIT_OK, "(8, 10), (1, 10) rejected");
+
+    // A long lower-priority job blocks a short deadline, unless it can be preempted
+    CHECK(ADMIT(SCHEDULER_PRIORITY, { 2, 5, 0 }, { 4, 20, 1 }) == ADMIT_ERR_UNSCHEDULABLE, "blocking ignored");
+    CHECK(ADMIT(SCHEDULER_PREEMPTIVE, { 2, 5, 0 }, { 4, 20, 1 }) == ADMIT_OK, "preemptive set rejected");
+
+    // The first job of the lowest task finishes at 9 ms, but its second, pushed back by its own first
+    // one, finishes 13 ms after its release
+    CHECK(ADMIT(SCHEDULER_PRIORITY, { 3, 8, 0 }, { 4, 9, 1 }) == ADMIT_OK, "(3, 8), (4, 9) rejected");
+    CHECK(ADMIT(SCHEDULER_PRIORITY, { 3, 8, 0 }, { 4, 9, 1 }, { 2, 12, 2 }) == ADMIT_ERR_UNSCHEDULABLE,
+          "later job of the busy period not checked");
+
+    // Overload, and full utilization under EDF
+    CHECK(ADMIT(SCHEDULER_PRIORITY, { 6, 10, 0 }, { 5, 10, 1 }) == ADMIT_ERR_UNSCHEDULABLE, "overload accepted");
+    CHECK(ADMIT(SCHEDULER_EDF, { 6, 10, 0 }, { 5, 10, 1 }) == ADMIT_ERR_UNSCHEDULABLE, "EDF overload accepted");
+    CHECK(ADMIT(SCHEDULER_EDF, { 5, 10, 0 }, { 10, 20, 1 }) == ADMIT_OK, "EDF at 100%% rejected");
+
+    // 1/3 + 2/3 + 1 ppm: truncating each term would sum to exactly 100%
+    CHECK(ADMIT(SCHEDULER_EDF, { 1, 3, 0 }, { 2, 3, 1 }, { 1, 1000000, 2 }) == ADMIT_ERR_UNSCHEDULABLE,
+          "overload hidden by rounding accepted");
+
+    // U = 0.8 is under the Liu & Layland bound, but only rate-monotonic priorities meet it: here the
+    // 300 ms job runs first and the 10 ms task responds after 305 ms
+    CHECK(ADMIT(SCHEDULER_PREEMPTIVE, { 5, 10, 1 }, { 300, 1000, 0 }) == ADMIT_ERR_UNSCHEDULABLE,
+          "inverted priorities accepted under the utilization bound");
+    CHECK(ADMIT(SCHEDULER_PREEMPTIVE, { 300, 1000, 0 }, { 5, 10, 1 }) == ADMIT_ERR_UNSCHEDULABLE,
+          "inverted priorities accepted under the utilization bound, added the other way");
+    CHECK(ADMIT(SCHEDULER_PREEMPTIVE, { 5, 10, 0 }, { 300, 1000, 1 }) == ADMIT_OK, "rate-monotonic pair rejected");
+
+    // A critical section of a lower-priority task blocks a higher one for its full length
+    static mutex_t ceiling_mutex, plain_mutex;
+    mutex_init_ceiling(&ceiling_mutex, 0);
+    CHECK(ADMIT(SCHEDULER_PREEMPTIVE, { 1, 5, 0 }, { 1, 100, 1 }) == ADMIT_OK, "preemptive pair rejected");
+    CHECK(scheduler_set_critical_section(1, &ceiling_mutex, 3000) == ADMIT_OK, "3 ms section rejected");
+    CHECK(scheduler_set_critical_section(1, &ceiling_mutex, 4500) == ADMIT_ERR_UNSCHEDULABLE, "4.5 ms section accepted");
+    CHECK(critical_sections[0].length_us == 3000, "rejected section kept: %u us", (unsigned)critical_sections[0].length_us);
+    CHECK(scheduler_set_critical_section(1, &plain_mutex, 1000) == ADMIT_ERR_CEILING, "section without a ceiling accepted");
+    // EDF dispatches by deadline, not at the ceiling, so a section there has no blocking bound
+    CHECK(ADMIT(SCHEDULER_EDF, { 1, 5, 0 }, { 1, 100, 1 }) == ADMIT_OK, "EDF pair rejected");
+    CHECK(scheduler_set_critical_section(1, &ceiling_mutex, 1000) == ADMIT_ERR_CEILING, "section under EDF accepted");
+    return check_failures != 0;
+}
@@ -0,0 +1,49 @@
+// A coroutine task resumes where it left off after each await: a delay wakes it on time, a condition
+// is seen within a tick of becoming true, and a yield returns to it in the same job
+#define RTOS_VIRTUAL_CLOCK
+#define RTOS_SIM_DURATION_US (10ULL * 1000000)
+#include "rtos_host.h"
+
+static volatile bool go;
+static uint64_t go_time, job_start;
+static uint64_t worst_delay_error, worst_condition_us;
+static int completed, yields_returned;
+
+static co_status_t waiter(coroutine_t *co, void *param) {
+    CO_BEGIN(co);
+    job_start = esp_timer_get_time();
+    CO_AWAIT_DELAY_MS(co, 5);
+    if (esp_timer_get_time() - (job_start + 5000) > worst_delay_error) {
+        worst_delay_error = esp_timer_get_time() - (job_start + 5000);
+    }
+    CO_AWAIT_UNTIL(co, go);
+    if (esp_timer_get_time() - go_time > worst_condition_us) {
+        worst_condition_us = esp_timer_get_time() - go_time;
+    }
+    go = false;
+    CO_YIELD(co);
+    yields_returned++;
+    completed++;
+    CO_END(co);
+}
+
+static void setter(void *param) {
+    if (!go) {
+        go = true;
+        go_time = esp_timer_get_time();
+    }
+}
+
+int main(void) {
+    scheduler_setup(SCHEDULER_PRIORITY);
+    scheduler_add_coroutine(waiter, NULL, 50, 1, 0);
+    scheduler_add_task(setter, NULL, 100, 0, 0);
+    scheduler_start();
+
+    // One job per setter release: it waits for `go` every time
+    CHECK(completed >= 98 && completed <= 100, "%d jobs completed", completed);
+    CHECK(yields_returned == completed, "%d of %d yields returned", yields_returned, completed);
+    CHECK(worst_delay_error == 0, "delay late by up to %llu us", (unsigned long long)worst_delay_error);
+    CHECK(worst_condition_us <= TICK_PERIOD_US, "condition seen after %llu us", (unsigned long long)worst_condition_us);
+    return check_failures != 0;
+}
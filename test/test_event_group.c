@@ -0,0 +1,91 @@
+// event_group_wait() on the virtual clock. A setter sets 5000 random sets of 4 bits, one per ms, for
+// four waiters that mix any/all, clear on exit and 5 ms timeouts. A wait that returns without its
+// bits has timed out exactly 5 ms after it began, and the waiter on bit 3 wakes once for every time
+// the bit goes from clear to set.
+#define RTOS_VIRTUAL_CLOCK
+#define RTOS_SIM_DURATION_US (60ULL * 1000000)
+#define MAX_TASKS 6
+#include "rtos_host.h"
+#include <stdlib.h>
+
+#define SETS 5000
+#define TIMEOUT_MS 5
+#define BIT3 (1u << 3)
+
+typedef struct {
+    uint32_t mask;
+    bool all;
+    uint32_t timeout_ms;
+    int wakes;
+    int timeouts;
+    int errors; // Timeouts that did not come timeout_ms after the wait began
+} waiter_t;
+
+static waiter_t waiters[] = {
+    { .mask = BIT3, .all = false, .timeout_ms = QUEUE_WAIT_FOREVER },
+    { .mask = 0x3, .all = false, .timeout_ms = TIMEOUT_MS },
+    { .mask = 0x6, .all = true, .timeout_ms = TIMEOUT_MS },
+    { .mask = 0x5, .all = true, .timeout_ms = TIMEOUT_MS },
+};
+
+#define WAITERS (int)(sizeof(waiters) / sizeof(waiters[0]))
+
+static event_group_t group;
+static int sets, bit3_edges;
+
+static void waiter(void *param) {
+    waiter_t *w = param;
+
+    while (1) {
+        uint64_t start = esp_timer_get_time();
+        uint32_t bits = event_group_wait(&group, w->mask, w->all, true, w->timeout_ms);
+        uint64_t waited = esp_timer_get_time() - start;
+        if (event_bits_match(bits, w->mask, w->all)) {
+            w->wakes++;
+        } else {
+            w->timeouts++;
+            w->errors += waited != (uint64_t)w->timeout_ms * 1000;
+        }
+    }
+}
+
+static void setter(void *param) {
+    uint32_t bits = rand() & 0xf;
+    uint32_t previous = event_group_set(&group, bits); // Every satisfied waiter runs before this returns
+
+    bit3_edges += (bits & BIT3) && !(previous & BIT3);
+    if (++sets == SETS) scheduler_stop();
+}
+
+int main(void) {
+    srand(1);
+    scheduler_setup(SCHEDULER_PREEMPTIVE);
+    for (int i = 0; i < WAITERS; i++) {
+        scheduler_add_task(waiter, &waiters[i], 1, i, 0); // Each job waits until the stop
+    }
+    scheduler_add_task(setter, NULL, 1, WAITERS, 0);
+    scheduler_start();
+
+    printf("%d sets: bit 3 went from clear to set %d times and woke its waiter %d times\n", sets, bit3_edges,
+           waiters[0].wakes);
+    CHECK(sets == SETS, "%d of %d sets", sets, SETS);
+    CHECK(waiters[0].wakes == bit3_edges, "%d wakes for %d edges", waiters[0].wakes, bit3_edges);
+    CHECK(waiters[0].timeouts == 0, "a wait forever timed out %d times", waiters[0].timeouts);
+    for (int i = 0; i < WAITERS; i++) {
+        printf("Waiter %d (%s of 0x%x): %d wakes, %d timeouts\n", i, waiters[i].all ? "all" : "any",
+               (unsigned)waiters[i].mask, waiters[i].wakes, waiters[i].timeouts);
+        CHECK(waiters[i].wakes > 0, "waiter %d never woke", i);
+        CHECK(waiters[i].errors == 0, "waiter %d: %d timeouts not %d ms after the wait", i, waiters[i].errors,
+              TIMEOUT_MS);
+    }
+    CHECK(waiters[2].timeouts > 0, "the all-of wait on 0x6 never timed out");
+
+    // Outside a task a wait polls: a satisfied one returns at once and clears, the others time out.
+    // A fresh group, since the waiters above are still listed on theirs.
+    event_group_t idle = { 0 };
+    event_group_set(&idle, 0x3);
+    CHECK(event_group_wait(&idle, 0x3, true, true, 0) == 0x3 && event_group_get(&idle) == 0, "bits 0x%x left",
+          (unsigned)event_group_get(&idle));
+    CHECK(event_group_wait(&idle, 0x1, false, false, 0) == 0, "an unset bit satisfied a wait");
+    return check_failures != 0;
+}
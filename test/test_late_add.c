@@ -0,0 +1,37 @@
+// A task added while the scheduler runs is first released one period after it is added, not at its
+// period counted from boot, which would already be in the past
+#define RTOS_VIRTUAL_CLOCK
+#define RTOS_SIM_DURATION_US (20ULL * 1000000)
+#include "rtos_host.h"
+
+#define ADD_AT_US 10500000
+
+static int late_task = -1;
+static uint64_t late_first_run;
+
+static void late(void *param) {
+    if (late_first_run == 0) late_first_run = esp_timer_get_time();
+}
+
+static void adder(void *param) {
+    if (late_task < 0 && esp_timer_get_time() >= ADD_AT_US) {
+        late_task = task_count;
+        scheduler_add_task(late, NULL, 1000, 1, 0);
+    }
+}
+
+int main(void) {
+    scheduler_setup(SCHEDULER_PRIORITY);
+    scheduler_add_task(adder, NULL, 500, 0, 0);
+    scheduler_start();
+
+    CHECK(late_task >= 0, "task was not added");
+    if (late_task < 0) return 1;
+    task_t *task = &task_list[late_task];
+    CHECK(late_first_run == ADD_AT_US + 1000000, "first job at %llu us", (unsigned long long)late_first_run);
+    CHECK(task->jobs == 9, "%u jobs", (unsigned)task->jobs);
+    CHECK(task->max_jitter_us == 0, "max release jitter %llu us", (unsigned long long)task->max_jitter_us);
+    CHECK(task->deadline_misses == 0, "%u deadlines missed", (unsigned)task->deadline_misses);
+    CHECK(task->overruns == 0, "%u overruns", (unsigned)task->overruns);
+    return check_failures != 0;
+}
@@ -0,0 +1,87 @@
+// Tasks blocked in mpmc_queue_pop() and mpmc_queue_push() are woken by the other side, not by a
+// tick: on the virtual clock, a consumer that blocked on an empty queue runs at the instant of the
+// push, and a producer that blocked on a full one at the instant of the pop. Two producers feed two
+// consumers through a 2-slot queue, and every item arrives once.
+#define RTOS_VIRTUAL_CLOCK
+#define RTOS_SIM_DURATION_US 2000000
+#define MAX_TASKS 8
+#include "rtos_host.h"
+
+#define PRODUCERS 2
+#define CONSUMERS 2
+#define PER_PRODUCER 400
+#define PER_JOB 8
+#define SERVICE_US 150 // A consumer's simulated work per item, so the queue fills
+
+MPMC_QUEUE_DEFINE(work, uint32_t, 2);
+
+static uint64_t pushed_at[PRODUCERS * PER_PRODUCER];
+static uint8_t seen[PRODUCERS * PER_PRODUCER];
+static uint32_t produced[PRODUCERS], consumed;
+static uint32_t blocked_pushes, blocked_pops, late_pushes, late_pops;
+static uint64_t last_pop_us;
+
+static void producer(void *param) {
+    int id = (int)(intptr_t)param;
+
+    for (int i = 0; i < PER_JOB && produced[id] < PER_PRODUCER; i++) {
+        uint32_t item = id * PER_PRODUCER + produced[id]++;
+        uint64_t start = esp_timer_get_time();
+        pushed_at[item] = start; // Before the push: the consumer it wakes preempts this task
+        mpmc_queue_push(&work, &item);
+        uint64_t end = esp_timer_get_time();
+        if (end != start) {
+            blocked_pushes++;
+            if (end != last_pop_us) late_pushes++;
+        }
+    }
+}
+
+static void consumer(void *param) {
+    uint32_t item;
+
+    while (1) {
+        uint64_t start = esp_timer_get_time();
+        mpmc_queue_pop(&work, &item);
+        uint64_t now = esp_timer_get_time();
+        last_pop_us = now;
+        if (now != start) {
+            blocked_pops++;
+            if (now != pushed_at[item]) late_pops++;
+        }
+        seen[item]++;
+        consumed++;
+        task_delay_until(now + SERVICE_US);
+    }
+}
+
+static void stopper(void *param) {
+    if (consumed == PRODUCERS * PER_PRODUCER) scheduler_stop();
+}
+
+int main(void) {
+    mpmc_queue_init(&work);
+    scheduler_setup(SCHEDULER_PREEMPTIVE);
+    scheduler_add_task(stopper, NULL, 10, 0, 0);
+    for (int c = 0; c < CONSUMERS; c++) {
+        scheduler_add_task(consumer, NULL, 1000, 1 + c, 0);
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        scheduler_add_task(producer, (void *)(intptr_t)p, 5, 1 + CONSUMERS + p, 0);
+    }
+    scheduler_start();
+
+    int missing = 0, duplicated = 0;
+    for (int i = 0; i < PRODUCERS * PER_PRODUCER; i++) {
+        missing += seen[i] == 0;
+        duplicated += seen[i] > 1;
+    }
+    CHECK(consumed == PRODUCERS * PER_PRODUCER, "%u of %d items consumed", (unsigned)consumed, PRODUCERS * PER_PRODUCER);
+    CHECK(missing == 0 && duplicated == 0, "%d items missing, %d delivered twice", missing, duplicated);
+    CHECK(blocked_pops > 0 && blocked_pushes > 0, "%u pops and %u pushes blocked", (unsigned)blocked_pops,
+          (unsigned)blocked_pushes);
+    CHECK(late_pops == 0, "%u of %u blocked pops resumed after the push", (unsigned)late_pops, (unsigned)blocked_pops);
+    CHECK(late_pushes == 0, "%u of %u blocked pushes resumed after the pop", (unsigned)late_pushes,
+          (unsigned)blocked_pushes);
+    return check_failures != 0;
+}
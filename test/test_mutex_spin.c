@@ -0,0 +1,130 @@
+// Adaptive mutex spinning on the host clock, two cores. A holder task locks the mutex for a 2 ms
+// section every 10 ms; a taker task checks every millisecond and tries to lock it during a section:
+// - holder running on the other core: the taker spins until the section ends and never blocks
+// - holder on the taker's core, preempted by it: the taker blocks at once without spinning
+// - holder on the other core but sleeping in task_delay_ms() with the mutex held: the same
+// The spin limit is effectively unbounded, so only the owner's state decides between spinning and
+// blocking. Each case runs in its own process, and the mutex statistics must match the locks made.
+#include "rtos_host.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define ROUNDS 40
+#define MAX_POLLS (100 * ROUNDS) // Give up rather than run forever if the two never overlap
+#define SECTION_US 2000
+
+typedef enum { RUN_OTHER_CORE, RUN_SAME_CORE, RUN_SUSPENDED } run_t;
+
+typedef struct {
+    int holder_locks;
+    int taker_locks;
+    int polls; // Times the taker checked for a section
+    int blocked; // Sections that ended with the taker blocked on the mutex
+    int spinning_locks; // Taker locks that counted spins
+    int contended_locks; // Taker locks that counted as contended
+    mutex_stats_t stats;
+} result_t;
+
+static run_t run;
+static result_t *result;
+static mutex_t section;
+static volatile bool holding;
+
+// Busy for the whole section as far as the scheduler knows, but in short host sleeps: when the cores
+// share a host CPU, spinning here would keep the taker's core from running until the section ends
+static void hold_section(void) {
+    int64_t end = esp_timer_get_time() + SECTION_US;
+    while (esp_timer_get_time() < end) {
+        usleep(50);
+    }
+}
+
+static void holder(void *param) {
+    mutex_lock(&section);
+    result->holder_locks++;
+    holding = true;
+    if (run == RUN_SUSPENDED) {
+        task_delay_ms(SECTION_US / 1000);
+    } else {
+        hold_section();
+    }
+    holding = false;
+    result->blocked += (section.owner & MUTEX_CONTENDED) != 0; // Only a blocked waiter sets the bit
+    mutex_unlock(&section);
+}
+
+// One job for the whole run: the holder's core may wake late on the host, so rather than expect the
+// section at a fixed point of its period, check every millisecond
+static void taker(void *param) {
+    while (result->taker_locks < ROUNDS && result->polls < MAX_POLLS) {
+        task_delay_ms(1);
+        result->polls++;
+        if (!holding) continue;
+        mutex_stats_t before = mutex_get_stats(&section);
+        mutex_lock(&section);
+        mutex_stats_t after = mutex_get_stats(&section);
+        result->taker_locks++;
+        result->spinning_locks += after.spins > before.spins;
+        result->contended_locks += after.contended > before.contended;
+        mutex_unlock(&section);
+    }
+    result->stats = mutex_get_stats(&section);
+    scheduler_stop();
+}
+
+// Holder and taker in a fresh process; the taker has the higher priority
+static void run_case(run_t which) {
+    *result = (result_t){ 0 };
+    if (fork() == 0) {
+        run = which;
+        scheduler_setup(SCHEDULER_PREEMPTIVE);
+        mutex_set_spin_limit(UINT32_MAX);
+        scheduler_add_task(holder, NULL, 10, 2, 0);
+        scheduler_add_task(taker, NULL, 10, 1, 0);
+        scheduler_set_affinity(0, which == RUN_SAME_CORE ? 0 : 1);
+        scheduler_set_affinity(1, 0);
+        scheduler_start();
+        _exit(0);
+    }
+    wait(NULL);
+}
+
+// What every case shares: the statistics count each lock once and the longest section
+static void check_stats(const char *name) {
+    const mutex_stats_t *stats = &result->stats;
+
+    printf("%s: %d taker locks (%d checks), %d spinning, %d blocked; stats %u acquisitions, %u contended, "
+           "%u spins, max hold %u us\n", name, result->taker_locks, result->polls, result->spinning_locks,
+           result->blocked, (unsigned)stats->acquisitions, (unsigned)stats->contended, (unsigned)stats->spins,
+           (unsigned)stats->max_hold_us);
+    CHECK(result->taker_locks == ROUNDS, "%s: %d of %d taker locks", name, result->taker_locks, ROUNDS);
+    CHECK(stats->acquisitions == (uint32_t)(result->holder_locks + result->taker_locks),
+          "%s: %u acquisitions for %d locks", name, (unsigned)stats->acquisitions,
+          result->holder_locks + result->taker_locks);
+    CHECK(stats->contended == (uint32_t)result->contended_locks, "%s: %u contended, taker saw %d", name,
+          (unsigned)stats->contended, result->contended_locks);
+    CHECK(stats->max_hold_us >= SECTION_US, "%s: max hold %u us", name, (unsigned)stats->max_hold_us);
+}
+
+int main(void) {
+    result = mmap(NULL, sizeof(result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    run_case(RUN_OTHER_CORE);
+    check_stats("Owner running on the other core");
+    CHECK(result->blocked == 0, "taker blocked %d times behind a running owner", result->blocked);
+    CHECK(result->spinning_locks > 0 && result->stats.spins > 0, "taker never spun");
+    CHECK(result->contended_locks == ROUNDS, "%d of %d taker locks contended", result->contended_locks, ROUNDS);
+
+    run_case(RUN_SAME_CORE);
+    check_stats("Owner on the same core");
+    CHECK(result->stats.spins == 0, "%u spins on a preempted owner", (unsigned)result->stats.spins);
+    CHECK(result->blocked == ROUNDS && result->contended_locks == ROUNDS, "%d blocked, %d contended of %d",
+          result->blocked, result->contended_locks, ROUNDS);
+
+    run_case(RUN_SUSPENDED);
+    check_stats("Owner suspended on the other core");
+    CHECK(result->stats.spins == 0, "%u spins on a suspended owner", (unsigned)result->stats.spins);
+    CHECK(result->blocked == ROUNDS && result->contended_locks == ROUNDS, "%d blocked, %d contended of %d",
+          result->blocked, result->contended_locks, ROUNDS);
+    return check_failures != 0;
+}
@@ -0,0 +1,96 @@
+// Releases stay on their absolute schedule over hours of simulated time, and each overrun policy
+// places the releases after a job that runs past its next one as documented
+#define RTOS_VIRTUAL_CLOCK
+#define RTOS_SIM_DURATION_US (4ULL * 3600 * 1000000)
+#include "rtos_host.h"
+
+#define STEADY_US 1000000
+#define OVERRUN_US 100000
+#define LONG_JOB_US 150000 // Every tenth job of an overrunning task
+
+typedef struct {
+    int jobs;
+    uint64_t first_start;
+    uint64_t last_start;
+    uint64_t last_release;
+    uint64_t last_end;
+    bool last_overran;
+    int errors;
+} record_t;
+
+static record_t records[4];
+
+// Check this job's release against the previous job, for the policy of the task running it
+static void check_release(int index, record_t *record, uint64_t release, uint64_t interval_us) {
+    if (record->jobs == 0) {
+        if (release != interval_us) record->errors++; // Added at time 0
+        return;
+    }
+    switch (task_list[index].overrun_policy) {
+        case OVERRUN_SKIP: // Missed releases are dropped, the phase is kept
+            if (release % interval_us != 0 || release <= record->last_release ||
+                (!record->last_overran && release != record->last_release + interval_us)) {
+                record->errors++;
+            }
+            break;
+        case OVERRUN_CATCH_UP: // Every release runs
+            if (release != record->last_release + interval_us) record->errors++;
+            break;
+        case OVERRUN_REPHASE: // A late job starts a new period from its end
+            if (release != (record->last_overran ? record->last_end : record->last_release) + interval_us) {
+                record->errors++;
+            }
+            break;
+    }
+}
+
+static void job(void *param) {
+    int index = (int)(intptr_t)param;
+    record_t *record = &records[index];
+    uint64_t interval_us = (uint64_t)task_list[index].interval_ms * 1000;
+    uint64_t release = task_list[index].next_release;
+    uint64_t start = esp_timer_get_time();
+
+    check_release(index, record, release, interval_us);
+    if (record->jobs == 0) record->first_start = start;
+    record->last_start = start;
+    record->last_release = release;
+    esp_rom_delay_us(index > 0 && record->jobs % 10 == 9 ? LONG_JOB_US : 1000);
+    record->jobs++;
+    record->last_end = esp_timer_get_time();
+    record->last_overran = record->last_end > release + interval_us;
+}
+
+int main(void) {
+    scheduler_setup(SCHEDULER_PRIORITY);
+    scheduler_add_task(job, (void *)0, STEADY_US / 1000, 0, 0);
+    scheduler_add_task(job, (void *)1, OVERRUN_US / 1000, 1, 0);
+    scheduler_add_task(job, (void *)2, OVERRUN_US / 1000, 2, 0);
+    scheduler_add_task(job, (void *)3, OVERRUN_US / 1000, 3, 0);
+    scheduler_set_overrun_policy(1, OVERRUN_SKIP);
+    scheduler_set_overrun_policy(2, OVERRUN_CATCH_UP);
+    scheduler_set_overrun_policy(3, OVERRUN_REPHASE);
+    scheduler_start();
+
+    // The steady task is delayed by the others' long jobs but never loses time: its average period
+    // over four hours is its interval to within the worst delay spread over every job
+    record_t *steady = &records[0];
+    uint64_t expected = (uint64_t)(steady->jobs - 1) * STEADY_US;
+    uint64_t measured = steady->last_start - steady->first_start;
+    uint64_t error = measured > expected ? measured - expected : expected - measured;
+    CHECK(steady->jobs == RTOS_SIM_DURATION_US / STEADY_US - 1, "steady task ran %d jobs", steady->jobs);
+    CHECK(error <= task_list[0].max_jitter_us, "period error %llu us over %d jobs", (unsigned long long)error,
+          steady->jobs);
+    CHECK(task_list[0].overruns == 0, "steady task overran %u times", (unsigned)task_list[0].overruns);
+
+    for (int i = 0; i < 4; i++) {
+        CHECK(records[i].errors == 0, "task %d: %d releases off schedule", i, records[i].errors);
+    }
+    for (int i = 1; i < 4; i++) {
+        CHECK(task_list[i].overruns > 0, "task %d never overran", i);
+    }
+    // Catching up runs every release; skipping drops some
+    CHECK(records[2].jobs >= RTOS_SIM_DURATION_US / OVERRUN_US - 10, "catch-up task ran %d jobs", records[2].jobs);
+    CHECK(records[1].jobs < records[2].jobs, "skip task ran %d jobs", records[1].jobs);
+    return check_failures != 0;
+}
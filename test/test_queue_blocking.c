@@ -0,0 +1,121 @@
+// Blocking queue_send()/queue_receive() on the host clock. A producer sends every 2 ms to a consumer
+// blocked in queue_receive() with a 3 ms timeout, first on the same core and then across cores: the
+// consumer is woken by the send, not at a tick, and nothing is lost or reordered over 3000 messages.
+// Then the producer skips sends, so receives time out, never early; and it sends bursts into a
+// 4-slot queue that a slow consumer drains, so sends block. A wait until time 0 is not a wait forever.
+#include "rtos_host.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define MESSAGES 3000
+#define TIMEOUT_MS 3
+#define BURST 8
+
+typedef enum { RUN_LATENCY, RUN_TIMEOUTS, RUN_BLOCKED_SENDERS } run_t;
+
+typedef struct {
+    uint64_t stamp;
+    int seq;
+} message_t;
+
+typedef struct {
+    int sent;
+    int received;
+    int out_of_order;
+    int timeouts;
+    int early_timeouts;
+    int blocked_sends;
+    uint64_t latency_sum;
+    uint64_t latency_max;
+} result_t;
+
+QUEUE_DEFINE(messages, message_t, 4);
+
+static run_t run;
+static result_t *result;
+
+static void producer(void *param) {
+    static int jobs;
+    if (run == RUN_TIMEOUTS && (++jobs & 1) && result->received < MESSAGES / 3) {
+        return; // Skip this job's send, so the consumer's receive times out
+    }
+    for (int i = 0; i < (run == RUN_BLOCKED_SENDERS ? BURST : 1); i++) {
+        uint64_t start = esp_timer_get_time();
+        message_t message = { start, result->sent };
+        if (!queue_send(&messages, &message, run == RUN_BLOCKED_SENDERS ? QUEUE_WAIT_FOREVER : 0)) continue;
+        if (esp_timer_get_time() - start > TICK_PERIOD_US / 2) result->blocked_sends++;
+        result->sent++;
+    }
+}
+
+static void consumer(void *param) {
+    static int expected;
+    message_t message;
+    uint64_t start = esp_timer_get_time();
+    bool received = queue_receive(&messages, &message, TIMEOUT_MS);
+    uint64_t now = esp_timer_get_time();
+
+    if (!received) {
+        result->timeouts++;
+        result->early_timeouts += now - start < TIMEOUT_MS * 1000;
+        return;
+    }
+    result->out_of_order += message.seq != expected;
+    expected = message.seq + 1;
+    result->received++;
+    result->latency_sum += now - message.stamp;
+    if (now - message.stamp > result->latency_max) result->latency_max = now - message.stamp;
+    if (run == RUN_BLOCKED_SENDERS) task_delay_ms(1);
+    if (result->received >= MESSAGES) scheduler_stop(); // A job may still run before it takes effect
+}
+
+// Producer on core 0 and consumer on `consumer_core`, in a fresh process
+static void run_queue(run_t which, int consumer_core) {
+    *result = (result_t){ 0 };
+    if (fork() == 0) {
+        run = which;
+        scheduler_setup(SCHEDULER_PREEMPTIVE);
+        scheduler_add_task(producer, NULL, 2, 5, 0);
+        scheduler_add_task(consumer, NULL, 1, 3, 0);
+        scheduler_set_affinity(0, 0);
+        scheduler_set_affinity(1, consumer_core);
+        scheduler_start();
+        _exit(0);
+    }
+    wait(NULL);
+}
+
+int main(void) {
+    message_t message;
+
+    // wake_us 0 is a time like any other, and already past
+    CHECK(!queue_wait(&messages, true, 0), "a wait until time 0 did not time out");
+    CHECK(!queue_receive(&messages, &message, 0), "received from an empty queue");
+
+    result = mmap(NULL, sizeof(result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    for (int core = 0; core < NUM_CORES; core++) {
+        run_queue(RUN_LATENCY, core);
+        uint64_t average = result->received ? result->latency_sum / result->received : 0;
+        printf("Consumer on core %d: %d messages, send to receive %llu us average, %llu us max\n", core,
+               result->received, (unsigned long long)average, (unsigned long long)result->latency_max);
+        CHECK(result->received >= MESSAGES && result->out_of_order == 0, "%d of %d messages received, %d out of order",
+              result->received, MESSAGES, result->out_of_order);
+        // Across cores the wakeup also waits for the host to run the other core's thread
+        CHECK(core != 0 || average < TICK_PERIOD_US / 4, "%llu us average latency: the consumer waited for a tick",
+              (unsigned long long)average);
+    }
+
+    run_queue(RUN_TIMEOUTS, 0);
+    printf("Skipped sends: %d receives timed out\n", result->timeouts);
+    CHECK(result->timeouts > 0 && result->early_timeouts == 0, "%d of %d timeouts early", result->early_timeouts,
+          result->timeouts);
+    CHECK(result->received >= MESSAGES && result->out_of_order == 0, "%d of %d messages received, %d out of order",
+          result->received, MESSAGES, result->out_of_order);
+
+    run_queue(RUN_BLOCKED_SENDERS, 0);
+    printf("Bursts into a full queue: %d sends blocked\n", result->blocked_sends);
+    CHECK(result->blocked_sends > 0, "no send blocked on the full queue");
+    CHECK(result->received >= MESSAGES && result->out_of_order == 0, "%d of %d messages received, %d out of order",
+          result->received, MESSAGES, result->out_of_order);
+    return check_failures != 0;
+}
@@ -0,0 +1,60 @@
+// queue.h and queue.hpp compile as C++ and work against the C implementation: Queue<T, N> keeps its
+// items inline and moves them one at a time (also from an ISR) and in batches, and QUEUE_DEFINE and
+// MPMC_QUEUE_DEFINE expand in a C++ file. Links the scheduler as the rtos_host library.
+#include "../src/queue.hpp"
+#include <cstdio>
+
+static int check_failures;
+#define CHECK(cond, ...) do { if (!(cond)) { printf("%s:%d: check failed: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); check_failures++; } } while (0)
+
+struct Sample {
+    uint16_t channel;
+    int32_t value;
+};
+
+static Queue<uint8_t, 64> bytes;
+static Queue<Sample, 8> samples;
+QUEUE_DEFINE(words, uint32_t, 16);
+MPMC_QUEUE_DEFINE(events, Sample, 4);
+
+int main() {
+    static_assert(sizeof(Queue<uint8_t, 64>) - sizeof(queue_t) <= 64 + PORT_CACHE_LINE_SIZE, "Items are stored inline");
+    static_assert(Queue<Sample, 8>::capacity() == 8, "Capacity is a compile-time constant");
+
+    int pushed = 0;
+    for (int i = 0; i < 70; i++) {
+        pushed += bytes.push(static_cast<uint8_t>(i));
+    }
+    CHECK(pushed == 64 && bytes.size() == 64, "%d of 70 bytes pushed, size %u", pushed, (unsigned)bytes.size());
+    uint8_t byte;
+    int popped = 0;
+    while (bytes.pop(byte)) {
+        CHECK(byte == popped, "byte %d popped as %d", popped, byte);
+        popped++;
+    }
+    CHECK(popped == 64, "%d bytes popped", popped);
+
+    Sample batch[8] = { { 3, -7 }, { 4, 8 }, { 5, -9 } };
+    CHECK(samples.push(batch, 3) == 3, "batch of 3 not pushed");
+    Sample out[8] = {};
+    uint32_t n = samples.pop(out, 8);
+    CHECK(n == 3 && out[0].channel == 3 && out[0].value == -7 && out[2].channel == 5 && out[2].value == -9,
+          "%u samples popped, first %u/%d", (unsigned)n, out[0].channel, out[0].value);
+    CHECK(queue_count(samples.handle()) == 0, "samples left behind");
+    bool woken = true;
+    CHECK(samples.push_from_isr(batch[1], woken) && !woken, "push_from_isr with no consumer waiting failed or woke one");
+    CHECK(samples.pop(out[0]) && out[0].channel == 4 && out[0].value == 8, "push_from_isr lost its item");
+
+    uint32_t word = 42;
+    CHECK(queue_push(&words, &word) && queue_pop(&words, &word) && word == 42, "QUEUE_DEFINE queue lost its item");
+
+    mpmc_queue_init(&events);
+    Sample event = { 7, 70 };
+    int accepted = 0;
+    while (mpmc_queue_try_push(&events, &event)) {
+        accepted++;
+    }
+    CHECK(accepted == 4, "MPMC queue of 4 took %d items", accepted);
+    CHECK(mpmc_queue_try_pop(&events, &event) && event.channel == 7 && event.value == 70, "MPMC item lost");
+    return check_failures != 0;
+}
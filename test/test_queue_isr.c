@@ -0,0 +1,108 @@
+// queue_send_from_isr() on the host clock, one core, preemptive mode. Every tick interrupt (SIGALRM)
+// sends one item into each of three queues: one a task blocks on in queue_receive(), one in a queue set
+// a task selects on, and one bound to an event-triggered task. Each consumer runs within a fraction of
+// a tick of the send, and nothing is lost or reordered over 1000 ticks.
+#define NUM_CORES 1
+#include "rtos_host.h"
+
+#define ITEMS 1000
+
+typedef struct {
+    uint64_t stamp;
+    int seq;
+} message_t;
+
+typedef struct {
+    int received;
+    int out_of_order;
+    uint64_t latency_sum;
+} consumer_t;
+
+QUEUE_DEFINE(direct, message_t, 8);
+QUEUE_DEFINE(selected, message_t, 8);
+QUEUE_DEFINE(activating, message_t, 8);
+static queue_set_t inputs;
+
+static volatile int sent, full, woken_ticks;
+static consumer_t consumers[3];
+
+static void consume(consumer_t *consumer, const message_t *message) {
+    consumer->out_of_order += message->seq != consumer->received;
+    consumer->latency_sum += esp_timer_get_time() - message->stamp;
+    consumer->received++;
+}
+
+// The tick handler with a device in it: send first, then the tick's own work, whose preemption check
+// is the scheduler_yield_from_isr() a woken task needs
+static void tick_isr(void *arg) {
+    if (sent < ITEMS) {
+        message_t message = { esp_timer_get_time(), sent++ };
+        bool woken, any = false;
+        full += !queue_send_from_isr(&direct, &message, &woken);
+        any |= woken;
+        full += !queue_send_from_isr(&selected, &message, &woken);
+        any |= woken;
+        full += !queue_send_from_isr(&activating, &message, &woken);
+        woken_ticks += any || woken;
+    }
+    timer_isr(arg);
+}
+
+static void receiver(void *param) {
+    message_t message;
+    while (consumers[0].received < ITEMS && queue_receive(&direct, &message, QUEUE_WAIT_FOREVER)) {
+        consume(&consumers[0], &message);
+    }
+}
+
+static void selector(void *param) {
+    message_t message;
+    while (consumers[1].received < ITEMS && queue_set_select(&inputs, QUEUE_WAIT_FOREVER) == &selected) {
+        while (queue_pop(&selected, &message)) consume(&consumers[1], &message);
+    }
+}
+
+static void on_item(void *param) {
+    message_t message;
+    while (queue_pop(&activating, &message)) consume(&consumers[2], &message);
+}
+
+// Hooks the tick once the first two consumers have blocked (port_timer_start() has installed it by
+// then), and stops once every item is through
+static void stopper(void *param) {
+    static int runs;
+    if (task_list[0].state == TASK_BLOCKED && task_list[1].state == TASK_BLOCKED) host_timer_isr = tick_isr;
+    runs++;
+    bool done = true;
+    for (int i = 0; i < 3; i++) {
+        done &= consumers[i].received == ITEMS;
+    }
+    if (done || runs == 3 * ITEMS) scheduler_stop();
+}
+
+int main(void) {
+    static const char *names[3] = { "Blocked receiver", "Queue set", "Activated task" };
+
+    queue_set_add_queue(&inputs, &selected);
+    scheduler_setup(SCHEDULER_PREEMPTIVE);
+    scheduler_add_task(receiver, NULL, 10, 1, 0);
+    scheduler_add_task(selector, NULL, 10, 2, 0);
+    scheduler_add_task(on_item, NULL, 0, 3, 0);
+    scheduler_add_task(stopper, NULL, 1, 4, 0);
+    scheduler_activate_on_queue(2, &activating);
+    scheduler_start();
+
+    printf("%d sends from the tick interrupt, %d woke a task\n", sent, woken_ticks);
+    for (int i = 0; i < 3; i++) {
+        uint64_t average = consumers[i].received ? consumers[i].latency_sum / consumers[i].received : 0;
+        printf("%-16s %4d items, %llu us average after the send\n", names[i], consumers[i].received,
+               (unsigned long long)average);
+        CHECK(consumers[i].received == ITEMS && consumers[i].out_of_order == 0, "%s: %d of %d items, %d out of order",
+              names[i], consumers[i].received, ITEMS, consumers[i].out_of_order);
+        CHECK(average < TICK_PERIOD_US / 4, "%s: %llu us average latency: it waited for a tick", names[i],
+              (unsigned long long)average);
+    }
+    CHECK(full == 0, "%d sends found a queue full", full);
+    CHECK(woken_ticks >= ITEMS * 9 / 10, "only %d of %d sends woke a task", woken_ticks, ITEMS);
+    return check_failures != 0;
+}
@@ -0,0 +1,99 @@
+// queue_set_select() on the host clock. A server task selects on two queues and a semaphore fed by
+// three periodic tasks on the same core, and is woken by each send or give, not at a tick: over 6000
+// messages nothing is lost or reordered. A select with nothing coming times out, never early.
+#include "rtos_host.h"
+
+#define MESSAGES 6000
+#define TIMEOUT_MS 3
+
+typedef struct {
+    uint64_t stamp;
+    int seq;
+} message_t;
+
+QUEUE_DEFINE(sensor, message_t, 8);
+QUEUE_DEFINE(command, message_t, 8);
+static semaphore_t button;
+static queue_set_t inputs;
+
+static int sent[2], expected[2];
+static int received, out_of_order, gives, takes;
+static uint64_t button_stamp, latency_sum, latency_max;
+
+static void record_latency(uint64_t stamp) {
+    uint64_t latency = esp_timer_get_time() - stamp;
+    latency_sum += latency;
+    if (latency > latency_max) latency_max = latency;
+    received++;
+}
+
+static void feeder(void *param) {
+    int id = (int)(intptr_t)param;
+
+    if (id == 2) {
+        button_stamp = esp_timer_get_time();
+        gives++;
+        semaphore_signal(&button);
+        return;
+    }
+    message_t message = { esp_timer_get_time(), sent[id]++ };
+    queue_send(id == 0 ? &sensor : &command, &message, 0);
+}
+
+static void server(void *param) {
+    message_t message;
+
+    while (received < MESSAGES) {
+        void *ready = queue_set_select(&inputs, QUEUE_WAIT_FOREVER);
+        if (ready == &button) {
+            if (semaphore_try_wait(&button)) {
+                takes++;
+                record_latency(button_stamp);
+            }
+            continue;
+        }
+        int id = ready == &sensor ? 0 : 1;
+        if (!queue_receive(ready, &message, 0)) continue;
+        out_of_order += message.seq != expected[id];
+        expected[id] = message.seq + 1;
+        record_latency(message.stamp);
+    }
+    scheduler_stop();
+}
+
+int main(void) {
+    semaphore_init(&button, 0);
+    CHECK(queue_set_add_queue(&inputs, &sensor) && queue_set_add_queue(&inputs, &command) &&
+          queue_set_add_semaphore(&inputs, &button), "could not add the members");
+    CHECK(!queue_set_add_queue(&inputs, &sensor), "a queue joined its set twice");
+
+    // Nothing is ready: outside a task the select polls until the timeout, and is never early
+    uint64_t start = esp_timer_get_time();
+    CHECK(queue_set_select(&inputs, 0) == NULL, "selected a member of an empty set");
+    CHECK(queue_set_select(&inputs, TIMEOUT_MS) == NULL, "selected a member of an empty set");
+    CHECK(esp_timer_get_time() - start >= TIMEOUT_MS * 1000, "the select timed out early");
+
+    scheduler_setup(SCHEDULER_PREEMPTIVE);
+    scheduler_add_task(server, NULL, 1, 0, 0); // Released first; its one job serves until the stop
+    scheduler_add_task(feeder, (void *)0, 1, 1, 0);
+    scheduler_add_task(feeder, (void *)1, 2, 2, 0);
+    scheduler_add_task(feeder, (void *)2, 3, 3, 0);
+    for (int i = 0; i < task_count; i++) {
+        scheduler_set_affinity(i, 0);
+    }
+    scheduler_start();
+
+    uint64_t average = received ? latency_sum / received : 0;
+    printf("%d messages (%d + %d queued, %d gives): send to dispatch %llu us average, %llu us max\n", received,
+           expected[0], expected[1], takes, (unsigned long long)average, (unsigned long long)latency_max);
+    CHECK(received >= MESSAGES && out_of_order == 0, "%d of %d messages received, %d out of order", received, MESSAGES,
+          out_of_order);
+    CHECK(expected[0] > 0 && expected[1] > 0 && takes > 0, "a member was starved: %d, %d, %d", expected[0],
+          expected[1], takes);
+    CHECK(gives - takes <= 1, "%d gives, %d taken", gives, takes); // The last one may come after the stop
+    CHECK(sent[0] - expected[0] <= 1 && sent[1] - expected[1] <= 1, "sent %d and %d, received %d and %d", sent[0],
+          sent[1], expected[0], expected[1]);
+    CHECK(average < TICK_PERIOD_US / 4, "%llu us average latency: the server waited for a tick",
+          (unsigned long long)average);
+    return check_failures != 0;
+}
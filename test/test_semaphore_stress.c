@@ -0,0 +1,86 @@
+// No semaphore update is lost under contention. Four threads hammer a count-2 semaphore through its
+// atomic fast paths, and never more than two are inside at once. Then interrupts give from both cores
+// while a task takes, and every give is taken exactly once.
+#include "rtos_host.h"
+
+#define HAMMER_THREADS 4
+#define HAMMER_ROUNDS 200000
+#define INTERRUPTS 5000
+
+static semaphore_t sem, irq_sem;
+static volatile int inside, max_inside;
+static volatile uint32_t raised[NUM_CORES], given, taken;
+static volatile bool device_done;
+
+static void *hammer(void *arg) {
+    for (int i = 0; i < HAMMER_ROUNDS; i++) {
+        semaphore_wait(&sem);
+        int now_inside = __atomic_add_fetch(&inside, 1, __ATOMIC_ACQ_REL);
+        if (now_inside > max_inside) max_inside = now_inside;
+        __atomic_sub_fetch(&inside, 1, __ATOMIC_ACQ_REL);
+        semaphore_signal(&sem);
+    }
+    return NULL;
+}
+
+// A device interrupt shares the IPI signal, which coalesces: give once per interrupt raised on this
+// core, then do the IPI's own work
+static void device_isr(void) {
+    for (uint32_t n = __atomic_exchange_n(&raised[port_core_id()], 0, __ATOMIC_ACQ_REL); n > 0; n--) {
+        semaphore_signal_from_isr(&irq_sem);
+        given++;
+    }
+    scheduler_ipi_isr();
+}
+
+static void *device(void *arg) {
+    for (int c = 0; c < NUM_CORES; c++) {
+        while (!host_core_ready[c]) usleep(100);
+    }
+    host_ipi_isr = device_isr;
+    for (int i = 0; i < INTERRUPTS; i++) {
+        __atomic_add_fetch(&raised[i % NUM_CORES], 1, __ATOMIC_ACQ_REL);
+        pthread_kill(host_core_threads[i % NUM_CORES], SIGUSR1);
+        usleep(50);
+    }
+    device_done = true;
+    return NULL;
+}
+
+static void consumer(void *param) {
+    while (1) {
+        semaphore_wait(&irq_sem);
+        taken++;
+    }
+}
+
+static void stopper(void *param) {
+    static int runs;
+    if ((device_done && taken == given) || ++runs == 300) scheduler_stop();
+}
+
+int main(void) {
+    pthread_t threads[HAMMER_THREADS], device_thread;
+
+    semaphore_init(&sem, 2);
+    for (int i = 0; i < HAMMER_THREADS; i++) {
+        pthread_create(&threads[i], NULL, hammer, NULL);
+    }
+    for (int i = 0; i < HAMMER_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    CHECK(sem.count == 2, "count %d after %d takes and gives", sem.count, HAMMER_THREADS * HAMMER_ROUNDS);
+    CHECK(max_inside <= 2, "%d threads inside a count-2 semaphore", max_inside);
+
+    semaphore_init(&irq_sem, 0);
+    scheduler_setup(SCHEDULER_PREEMPTIVE);
+    scheduler_add_task(consumer, NULL, 10, 2, 0);
+    scheduler_add_task(stopper, NULL, 100, 0, 0);
+    pthread_create(&device_thread, NULL, device, NULL);
+    scheduler_start();
+    pthread_join(device_thread, NULL);
+    CHECK(given == INTERRUPTS, "%u interrupts delivered", (unsigned)given);
+    CHECK(taken == given, "%u gives from interrupts, %u taken", (unsigned)given, (unsigned)taken);
+    CHECK(irq_sem.count == 0 || irq_sem.count == -1, "count %d left over", irq_sem.count);
+    return check_failures != 0;
+}
@@ -0,0 +1,95 @@
+// Software timers on the virtual clock. 500 timers, half of them periodic, with periods of 1-200 ms,
+// take 5 random starts, stops or resets every ms for 20 s, and some periodic callbacks stop their own
+// timer. A model of each timer follows every call: no callback runs early, late or after its timer
+// was stopped, and start() and stop() report whether the timer was running.
+#define RTOS_VIRTUAL_CLOCK
+#define RTOS_SIM_DURATION_US (30ULL * 1000000)
+#include "rtos_host.h"
+#include <stdlib.h>
+
+#define TIMERS 500
+#define CALLS_PER_MS 5
+#define RUN_MS 20000
+#define SELF_STOP_EVERY 7 // Expiries of a periodic timer after which its callback stops it
+
+typedef struct {
+    soft_timer_t timer;
+    bool running;
+    uint64_t due;
+} model_t;
+
+static model_t models[TIMERS];
+static int jobs, callbacks, early, late, stopped_fired, self_stops, wrong_returns;
+
+static void expired(soft_timer_t *timer, void *arg) {
+    model_t *model = arg;
+    uint64_t now = esp_timer_get_time();
+
+    callbacks++;
+    if (!model->running) {
+        stopped_fired++;
+        return;
+    }
+    early += now < model->due;
+    late += now > model->due;
+    if (!timer->periodic) {
+        model->running = false;
+    } else if (timer->expiries % SELF_STOP_EVERY == 0) {
+        wrong_returns += !soft_timer_stop(timer);
+        model->running = false;
+        self_stops++;
+    } else {
+        model->due += (uint64_t)timer->period_ms * 1000;
+    }
+}
+
+// Start, stop or reset a random timer, and follow the call in its model
+static void random_call(void) {
+    model_t *model = &models[rand() % TIMERS];
+    uint64_t due = esp_timer_get_time() + (uint64_t)model->timer.period_ms * 1000;
+
+    switch (rand() % 3) {
+        case 0:
+            wrong_returns += soft_timer_start(&model->timer) == model->running;
+            if (!model->running) model->due = due;
+            model->running = true;
+            break;
+        case 1:
+            wrong_returns += soft_timer_stop(&model->timer) != model->running;
+            model->running = false;
+            break;
+        case 2:
+            soft_timer_reset(&model->timer);
+            model->due = due;
+            model->running = true;
+            break;
+    }
+}
+
+static void churn(void *param) {
+    for (int i = 0; i < CALLS_PER_MS; i++) {
+        random_call();
+    }
+    if (++jobs == RUN_MS) scheduler_stop();
+}
+
+int main(void) {
+    srand(1);
+    CHECK(!soft_timer_create(&models[0].timer, 0, true, expired, &models[0]), "a periodic timer had no period");
+    for (int i = 0; i < TIMERS; i++) {
+        soft_timer_create(&models[i].timer, 1 + rand() % 200, i % 2 == 0, expired, &models[i]);
+    }
+
+    scheduler_setup(SCHEDULER_PREEMPTIVE);
+    scheduler_add_timer_service(0, 0, 0); // Above the churn, so every due callback runs before a call
+    scheduler_add_task(churn, NULL, 1, 1, 0);
+    scheduler_start();
+
+    printf("%d callbacks, %d of which stopped their own timer\n", callbacks, self_stops);
+    CHECK(jobs == RUN_MS, "%d of %d ms of calls", jobs, RUN_MS);
+    CHECK(callbacks > 0 && self_stops > 0, "%d callbacks, %d self-stops", callbacks, self_stops);
+    CHECK(early == 0 && late == 0, "%d callbacks early, %d late", early, late);
+    CHECK(stopped_fired == 0, "%d callbacks after a stop", stopped_fired);
+    CHECK(wrong_returns == 0, "%d starts or stops misreported the timer's state", wrong_returns);
+    return check_failures != 0;
+}
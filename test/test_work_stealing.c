@@ -0,0 +1,57 @@
+// Work-stealing hints: entries for jobs their core has already dispatched must not fill the steal deque
+// and keep later jobs from being offered. Drives core 0's ready queue directly, without starting the
+// scheduler: task 0 stays ready at low priority while tasks 1 and 2 take turns, each dispatched while
+// the other's newer hint sits above its own. Task 3 then becomes ready for the first time.
+#include "rtos_host.h"
+
+#define STEPS 1000
+
+static void work(void *param) {
+}
+
+// Whether a thief would find the task between the deque's top and bottom
+static bool offered(const core_t *core, int index) {
+    for (int32_t i = core->steal_deque.top; i < core->steal_deque.bottom; i++) {
+        if (core->steal_deque.items[i & (STEAL_DEQUE_SIZE - 1)] == index) return true;
+    }
+    return false;
+}
+
+static void make_ready(int index) {
+    task_list[index].state = TASK_READY;
+    ready_push(&cores[0], index);
+}
+
+static void run_job(int index) {
+    ready_remove(&cores[0], index);
+    task_list[index].state = TASK_WAITING; // Dispatched, and its job done
+}
+
+int main(void) {
+    core_t *core = &cores[0];
+    int missing = 0;
+    int32_t max_entries = 0;
+
+    scheduler_setup(SCHEDULER_PRIORITY);
+    scheduler_set_work_stealing(true);
+    for (int i = 0; i < 4; i++) {
+        scheduler_add_task(work, NULL, 1000, 3 - i, 0);
+        task_list[i].core = 0;
+    }
+
+    make_ready(0);
+    make_ready(1);
+    for (int step = 0; step < STEPS; step++) {
+        int next = step % 2 == 0 ? 2 : 1;
+        make_ready(next);
+        run_job(3 - next);
+        if (!offered(core, next) || !offered(core, 0)) missing++;
+        int32_t entries = core->steal_deque.bottom - core->steal_deque.top;
+        if (entries > max_entries) max_entries = entries;
+    }
+    CHECK(missing == 0, "ready jobs not offered after %d of %d steps", missing, STEPS);
+    make_ready(3);
+    CHECK(offered(core, 3), "new job not offered");
+    printf("%d steps, at most %d deque entries\n", STEPS, (int)max_entries);
+    return check_failures != 0;
+}